@@ -1,98 +1,624 @@
 #include "chip8.h"
+#include "metrics.h"
 
+#include <algorithm>
+#include <atomic>
 #include <fstream>
-#include <SDL3/SDL.h>
-#include <random>
-
-// mapping keycodes with indexes
-const uint8_t keymap[16] = {
-    SDL_SCANCODE_1,
-    SDL_SCANCODE_2,
-    SDL_SCANCODE_3,
-    SDL_SCANCODE_4,
-    SDL_SCANCODE_Q,
-    SDL_SCANCODE_W,
-    SDL_SCANCODE_E,
-    SDL_SCANCODE_R,
-    SDL_SCANCODE_A,
-    SDL_SCANCODE_S,
-    SDL_SCANCODE_D,
-    SDL_SCANCODE_F,
-    SDL_SCANCODE_Z,
-    SDL_SCANCODE_X,
-    SDL_SCANCODE_C,
-    SDL_SCANCODE_V
-};
+#include <ctime>
+#include <cstdlib>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+// reads memory through its page, writes go through write_memory(); fuzzing builds (CHIP8_CHECKED)
+// abort on any access outside of memory, addresses computed by instructions wrap around the 4KB
+// so this never fires
+#ifdef CHIP8_CHECKED
+#define MEM(addr) pages[((addr) < 4096 ? (addr) : (abort(), 0)) / PAGE_SIZE][(addr) % PAGE_SIZE]
+#else
+#define MEM(addr) pages[(addr) / PAGE_SIZE][(addr) % PAGE_SIZE]
+#endif
+
+// Zobrist builds (CHIP8_ZOBRIST) keep a hash of the state up to date, code changing registers is
+// wrapped in these so the words it changed are hashed again; other builds compile them away
+#ifdef CHIP8_ZOBRIST
+#define REGISTERS_CHANGING() uint64_t registers_before[REGISTER_WORDS]; register_words(*this, registers_before)
+#define REGISTERS_CHANGED() rehash_registers(registers_before)
+#else
+#define REGISTERS_CHANGING()
+#define REGISTERS_CHANGED()
+#endif
+
+static_assert(offsetof(Chip8Core, display) == 64, "registers fill exactly one cache line");
+static_assert(sizeof(Chip8Core) == 64 + 256, "no padding between registers and display");
+static_assert(sizeof(Chip8) <= 512, "machine without its private pages fits in 512 bytes");
+
+// Fixed size blocks for memory pages and forked machines. Every thread keeps its own free list
+// so the hot path takes no lock, the shared list only refills it and collects the blocks of
+// exited threads. Blocks are never returned to the system, they are reused by later machines.
+namespace {
+    template <size_t BYTES>
+    class BlockPool {
+    public:
+        static constexpr size_t BLOCKS_PER_CHUNK = 64;
+
+        static void* acquire() {
+            if (cache_gone) {
+                // thread is exiting, blocks come straight from the shared list
+                Shared& s = shared();
+                std::lock_guard<std::mutex> lock(s.mutex);
+                if (!s.free.empty()) {
+                    void* block = s.free.back();
+                    s.free.pop_back();
+                    return block;
+                }
+                return ::operator new(BYTES, std::align_val_t(64));
+            }
 
-Chip8::Chip8() {
-    // fontset values
-    const uint8_t fontset[16][5] = {
-        {0xF0, 0x90, 0x90, 0x90, 0xF0}, // 0
-        {0x20, 0x60, 0x20, 0x20, 0x70}, // 1
-        {0xF0, 0x10, 0xF0, 0x80, 0xF0}, // 2
-        {0xF0, 0x10, 0xF0, 0x10, 0xF0}, // 3
-        {0x90, 0x90, 0xF0, 0x10, 0x10}, // 4
-        {0xF0, 0x80, 0xF0, 0x10, 0xF0}, // 5
-        {0xF0, 0x80, 0xF0, 0x90, 0xF0}, // 6
-        {0xF0, 0x10, 0x20, 0x40, 0x40}, // 7
-        {0xF0, 0x90, 0xF0, 0x90, 0xF0}, // 8
-        {0xF0, 0x90, 0xF0, 0x10, 0xF0}, // 9
-        {0xF0, 0x90, 0xF0, 0x90, 0x90}, // A
-        {0xE0, 0x90, 0xE0, 0x90, 0xE0}, // B
-        {0xF0, 0x80, 0x80, 0x80, 0xF0}, // C
-        {0xE0, 0x90, 0x90, 0x90, 0xE0}, // D
-        {0xF0, 0x80, 0xF0, 0x80, 0xF0}, // E
-        {0xF0, 0x80, 0xF0, 0x80, 0x80}  // F
+            std::vector<void*>& free = cache.free;
+            if (free.empty()) {
+                Shared& s = shared();
+                std::lock_guard<std::mutex> lock(s.mutex);
+                size_t take = std::min(s.free.size(), BLOCKS_PER_CHUNK);
+                free.insert(free.end(), s.free.end() - take, s.free.end());
+                s.free.resize(s.free.size() - take);
+            }
+
+            if (free.empty()) {
+                uint8_t* chunk = (uint8_t*)::operator new(BLOCKS_PER_CHUNK * BYTES, std::align_val_t(64));
+                for (size_t i = 0; i < BLOCKS_PER_CHUNK; i++)
+                    free.push_back(chunk + i * BYTES);
+            }
+
+            void* block = free.back();
+            free.pop_back();
+            return block;
+        }
+
+        // never throws, so machines are destroyed and reset without failing; when the free
+        // list cannot grow for lack of memory the block is lost instead
+        static void release(void* block) noexcept {
+            try {
+                if (cache_gone) {
+                    Shared& s = shared();
+                    std::lock_guard<std::mutex> lock(s.mutex);
+                    s.free.push_back(block);
+                    return;
+                }
+
+                cache.free.push_back(block);
+            } catch (const std::bad_alloc&) {
+            }
+        }
+
+    private:
+        struct Shared {
+            std::mutex mutex;
+            std::vector<void*> free;
+        };
+
+        // never destroyed, machines with static storage may release blocks after exit handlers ran
+        static Shared& shared() {
+            static Shared* s = new Shared;
+            return *s;
+        }
+
+        struct Cache {
+            std::vector<void*> free;
+
+            ~Cache() {
+                Shared& s = shared();
+                std::lock_guard<std::mutex> lock(s.mutex);
+                s.free.insert(s.free.end(), free.begin(), free.end());
+                cache_gone = true;
+            }
+        };
+
+        static thread_local bool cache_gone;
+        static thread_local Cache cache;
     };
 
-    pc = 0x200; // starting address
-    index = 0;
+    template <size_t BYTES> thread_local bool BlockPool<BYTES>::cache_gone = false;
+    template <size_t BYTES> thread_local typename BlockPool<BYTES>::Cache BlockPool<BYTES>::cache;
+
+    // a page is its 256 bytes followed by the number of machines referencing it
+    const size_t PAGE_BYTES = 256;
+    typedef BlockPool<PAGE_BYTES + sizeof(std::atomic<uint32_t>)> PagePool;
+    typedef BlockPool<sizeof(Chip8)> MachinePool;
+
+    std::atomic<uint32_t>& page_refs(const uint8_t* page) {
+        return *(std::atomic<uint32_t>*)(page + PAGE_BYTES);
+    }
+
+    uint8_t* acquire_page() {
+        uint8_t* page = (uint8_t*)PagePool::acquire();
+        new (&page_refs(page)) std::atomic<uint32_t>(1);
+        return page;
+    }
+
+    void retain_page(const uint8_t* page) {
+        page_refs(page).fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release_page(const uint8_t* page) {
+        // last machine referencing the page returns it, the acquire pairs with the other releases
+        if (page_refs(page).fetch_sub(1, std::memory_order_acq_rel) == 1)
+            PagePool::release((void*)page);
+    }
+}
+
+// places a sprite byte at column x of a display row, pixels past the right edge wrap to the left
+static constexpr uint64_t sprite_row(uint8_t byte, int x) {
+    uint64_t row = (uint64_t)byte << 56;
+    return (row >> x) | (row << ((64 - x) & 63));
+}
+
+static_assert(sprite_row(0xFF, 0) == 0xFF00000000000000ull, "sprite starts at the leftmost pixel");
+static_assert(sprite_row(0xFF, 60) == 0xF00000000000000Full, "sprite wraps around the right edge");
+
+// Zobrist keys, one per hashed word of the state: 8 register words, 32 display rows and 512
+// memory words. The state hash is the XOR of zobrist(position, word) over all of them, so a
+// write changes it by the hashes of the old and the new word.
+static const unsigned REGISTER_WORDS = 8;
+static const unsigned ZOBRIST_REGISTERS = 0;
+static const unsigned ZOBRIST_DISPLAY = ZOBRIST_REGISTERS + REGISTER_WORDS;
+static const unsigned ZOBRIST_MEMORY = ZOBRIST_DISPLAY + 32;
+static const unsigned ZOBRIST_POSITIONS = ZOBRIST_MEMORY + 4096 / 8;
+
+struct ZobristKeys {
+    uint64_t key[ZOBRIST_POSITIONS];
+};
+
+// splitmix64 sequence, generated at compile time
+static constexpr ZobristKeys make_zobrist_keys() {
+    ZobristKeys keys = {};
+    uint64_t x = 0x243F6A8885A308D3ull;
+    for (unsigned i = 0; i < ZOBRIST_POSITIONS; i++) {
+        uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        keys.key[i] = z ^ (z >> 31);
+    }
+    return keys;
+}
+
+static constexpr ZobristKeys zobrist_keys = make_zobrist_keys();
+
+// key of a word at a position, words are mixed so equal values at different positions never cancel
+static inline uint64_t zobrist(unsigned position, uint64_t word) {
+    uint64_t h = zobrist_keys.key[position] ^ word;
+    h = (h ^ (h >> 33)) * 0xFF51AFD7ED558CCDull;
+    h = (h ^ (h >> 33)) * 0xC4CEB9FE1A85EC53ull;
+    return h ^ (h >> 33);
+}
+
+static inline uint64_t memory_word(const uint8_t* bytes) {
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+// registers packed into words, field by field so padding never reaches the hash
+static void register_words(const Chip8Core& core, uint64_t (&words)[REGISTER_WORDS]) {
+    uint8_t bytes[48];
+    memcpy(bytes, core.v, sizeof(core.v));
+    memcpy(bytes + 16, &core.pc, sizeof(core.pc));
+    memcpy(bytes + 18, &core.index, sizeof(core.index));
+    memcpy(bytes + 20, core.stack, 14 * sizeof(uint16_t));
+
+    for (unsigned i = 0; i < 6; i++)
+        words[i] = memory_word(bytes + i * 8);
+    words[6] = core.stack[14] | (uint64_t)core.stack[15] << 16 | (uint64_t)core.sp << 32 |
+        (uint64_t)core.delay_timer << 40 | (uint64_t)core.sound_timer << 48;
+    words[7] = core.keys | (uint64_t)core.rng_state << 32;
+}
+
+uint64_t Chip8::hash_state(const Chip8State& state) {
+    uint64_t words[REGISTER_WORDS];
+    register_words(state, words);
+
+    uint64_t h = 0;
+    for (unsigned i = 0; i < REGISTER_WORDS; i++)
+        h ^= zobrist(ZOBRIST_REGISTERS + i, words[i]);
+    for (unsigned y = 0; y < 32; y++)
+        h ^= zobrist(ZOBRIST_DISPLAY + y, state.display[y]);
+    for (unsigned w = 0; w < 4096 / 8; w++)
+        h ^= zobrist(ZOBRIST_MEMORY + w, memory_word(state.memory + w * 8));
+
+    return h;
+}
+
+// fontset values
+const uint8_t Chip8::FONT[16][5] = {
+    {0xF0, 0x90, 0x90, 0x90, 0xF0}, // 0
+    {0x20, 0x60, 0x20, 0x20, 0x70}, // 1
+    {0xF0, 0x10, 0xF0, 0x80, 0xF0}, // 2
+    {0xF0, 0x10, 0xF0, 0x10, 0xF0}, // 3
+    {0x90, 0x90, 0xF0, 0x10, 0x10}, // 4
+    {0xF0, 0x80, 0xF0, 0x10, 0xF0}, // 5
+    {0xF0, 0x80, 0xF0, 0x90, 0xF0}, // 6
+    {0xF0, 0x10, 0x20, 0x40, 0x40}, // 7
+    {0xF0, 0x90, 0xF0, 0x90, 0xF0}, // 8
+    {0xF0, 0x90, 0xF0, 0x10, 0xF0}, // 9
+    {0xF0, 0x90, 0xF0, 0x90, 0x90}, // A
+    {0xE0, 0x90, 0xE0, 0x90, 0xE0}, // B
+    {0xF0, 0x80, 0x80, 0x80, 0xF0}, // C
+    {0xE0, 0x90, 0x90, 0x90, 0xE0}, // D
+    {0xF0, 0x80, 0xF0, 0x80, 0xF0}, // E
+    {0xF0, 0x80, 0xF0, 0x80, 0x80}  // F
+};
 
-    delay_timer = 0;
-    sound_timer = 0;
+// state right after construction, built once and copied into every new or reset machine
+static const std::shared_ptr<const Chip8BootImage>& pristine_state() {
+    static const std::shared_ptr<const Chip8BootImage> state = [] {
+        auto s = std::make_shared<Chip8BootImage>();
+        memset(s.get(), 0, sizeof(Chip8BootImage)); // empty memory, display, stack, registers and keyboard, padding too
 
-    memset(v, 0, sizeof(v)); // initialize all V registers to 0
-    memset(keyboard, 0, sizeof(keyboard)); // initialize keyboard to 0
-    memset(memory, 0, sizeof(memory)); // initialize memory to 0
-    memset(display, 0, sizeof(display)); // initialize empty display
+        s->pc = 0x200; // starting address
+        s->rng_state = 0x9E3779B9; // xorshift state must never be 0
+
+        // load fontset in memory
+        memcpy(s->memory + Chip8::FONT_ADDRESS, Chip8::FONT, sizeof(Chip8::FONT));
+#ifdef CHIP8_ZOBRIST
+        s->hash = Chip8::hash_state(*s);
+#endif
+
+        return std::shared_ptr<const Chip8BootImage>(s);
+    }();
+
+    return state;
+}
+
+Chip8::Chip8() {
+    pool_pages = 0;
+    writable_pages = 0;
+    quirk_flags = 0;
+    frame_cycles = CYCLES_PER_FRAME;
+    draw_count = 0;
+    collision_count = 0;
+    boot_state = pristine_state();
+    boot();
     draw_flag = false;
 
-    sp = 0; // first empty stack location
-    memset(stack, 0, sizeof(stack)); // initialize empty stack
+    seed((uint32_t)time(NULL));
+}
+
+Chip8::Chip8(const Chip8& other) : Chip8Core(other) {
+    draw_flag = other.draw_flag;
+    quirk_flags = other.quirk_flags;
+    frame_cycles = other.frame_cycles;
+    draw_count = other.draw_count;
+    collision_count = other.collision_count;
+    boot_state = other.boot_state;
+
+    // pages are shared with the other machine, whichever writes first copies
+    for (unsigned p = 0; p < PAGES; p++) {
+        pages[p] = other.pages[p];
+        if (other.pool_pages & (1 << p))
+            retain_page(pages[p]);
+    }
+    pool_pages = other.pool_pages;
+    writable_pages = other.writable_pages = 0; // both reference the pages now
+    code_base = NO_CODE_PAGE;
+
+#ifdef CHIP8_ZOBRIST
+    zobrist_hash = other.zobrist_hash;
+#endif
+}
+
+Chip8& Chip8::operator=(const Chip8& other) {
+    if (this == &other)
+        return *this;
+
+    static_cast<Chip8Core&>(*this) = other;
+    draw_flag = other.draw_flag;
+    quirk_flags = other.quirk_flags;
+    frame_cycles = other.frame_cycles;
+    draw_count = other.draw_count;
+    collision_count = other.collision_count;
+
+    for (unsigned p = 0; p < PAGES; p++)
+        if (other.pool_pages & (1 << p))
+            retain_page(other.pages[p]);
+    release_pages();
+
+    for (unsigned p = 0; p < PAGES; p++)
+        pages[p] = other.pages[p];
+    pool_pages = other.pool_pages;
+    writable_pages = other.writable_pages = 0; // both reference the pages now
+    code_base = NO_CODE_PAGE;
+    boot_state = other.boot_state; // after releasing, the old image may back nothing now
+
+#ifdef CHIP8_ZOBRIST
+    zobrist_hash = other.zobrist_hash;
+#endif
+    return *this;
+}
+
+Chip8::~Chip8() {
+    release_pages();
+}
+
+void* Chip8::operator new(size_t size) {
+    return size == sizeof(Chip8) ? MachinePool::acquire() : ::operator new(size, std::align_val_t(alignof(Chip8)));
+}
+
+void Chip8::operator delete(void* machine, size_t size) {
+    if (size == sizeof(Chip8))
+        MachinePool::release(machine);
+    else
+        ::operator delete(machine, std::align_val_t(alignof(Chip8)));
+}
+
+std::unique_ptr<Chip8> Chip8::fork() const {
+    return std::unique_ptr<Chip8>(new Chip8(*this));
+}
+
+void Chip8::release_pages() {
+    for (unsigned p = 0; p < PAGES; p++)
+        if (pool_pages & (1 << p))
+            release_page(pages[p]);
+
+    pool_pages = 0;
+    writable_pages = 0;
+}
+
+void Chip8::boot() {
+    release_pages();
+    static_cast<Chip8Core&>(*this) = *boot_state;
+
+    for (unsigned p = 0; p < PAGES; p++)
+        pages[p] = boot_state->memory + p * PAGE_SIZE;
+    code_base = NO_CODE_PAGE;
+
+#ifdef CHIP8_ZOBRIST
+    zobrist_hash = boot_state->hash;
+#endif
+    draw_flag = true; // display may have changed
+}
+
+void Chip8::write_memory(uint16_t addr, const uint8_t* src, unsigned count) {
+#ifdef CHIP8_CHECKED
+    if (addr >= 4096 || count > PAGE_SIZE)
+        abort();
+#endif
+
+#ifdef CHIP8_ZOBRIST
+    zobrist_hash ^= memory_hash(addr, count);
+#endif
+
+    // usually the range is inside one page the machine already owns, written in place
+    unsigned offset = addr % PAGE_SIZE;
+    if ((writable_pages & (1 << addr / PAGE_SIZE)) && count <= PAGE_SIZE - offset) {
+        uint8_t* dst = (uint8_t*)pages[addr / PAGE_SIZE] + offset;
+        for (unsigned i = 0; i < count; i++)
+            dst[i] = src[i];
+    } else {
+        write_pages(addr, src, count);
+    }
+
+#ifdef CHIP8_ZOBRIST
+    zobrist_hash ^= memory_hash(addr, count);
+#endif
+}
+
+void Chip8::write_pages(uint16_t addr, const uint8_t* src, unsigned count) {
+    // range touches at most two pages, the second one after wrapping past 0xFFF
+    unsigned first = std::min(count, PAGE_SIZE - addr % PAGE_SIZE);
+    memcpy(own_page(addr / PAGE_SIZE) + addr % PAGE_SIZE, src, first);
+    if (count > first)
+        memcpy(own_page(((addr + first) & 0xFFF) / PAGE_SIZE), src + first, count - first);
+}
+
+void Chip8::read_memory(uint8_t* dst, uint16_t addr, unsigned count) const {
+#ifdef CHIP8_CHECKED
+    if (addr >= 4096 || count > PAGE_SIZE)
+        abort();
+#endif
+
+    unsigned first = std::min(count, PAGE_SIZE - addr % PAGE_SIZE);
+    const uint8_t* src = pages[addr / PAGE_SIZE] + addr % PAGE_SIZE;
+    for (unsigned i = 0; i < first; i++)
+        dst[i] = src[i];
+    if (count > first)
+        memcpy(dst + first, pages[((addr + first) & 0xFFF) / PAGE_SIZE], count - first);
+}
+
+#ifdef CHIP8_ZOBRIST
+uint64_t Chip8::memory_hash(uint16_t addr, unsigned count) const {
+    // words covering the range, wrapping past 0xFFF like the range itself
+    uint64_t h = 0;
+    unsigned last = ((addr + count - 1) & 0xFFF) / 8;
+    for (unsigned w = addr / 8; ; w = (w + 1) % (4096 / 8)) {
+        h ^= zobrist(ZOBRIST_MEMORY + w, memory_word(pages[w * 8 / PAGE_SIZE] + w * 8 % PAGE_SIZE));
+        if (w == last)
+            break;
+    }
+    return h;
+}
+
+uint64_t Chip8::display_hash() const {
+    uint64_t h = 0;
+    for (unsigned y = 0; y < 32; y++)
+        h ^= zobrist(ZOBRIST_DISPLAY + y, display[y]);
+    return h;
+}
+
+void Chip8::rehash_registers(const uint64_t* before) {
+    // an instruction changes one or two of the words, only those are hashed again
+    uint64_t after[REGISTER_WORDS];
+    register_words(*this, after);
+    for (unsigned i = 0; i < REGISTER_WORDS; i++)
+        if (before[i] != after[i])
+            zobrist_hash ^= zobrist(ZOBRIST_REGISTERS + i, before[i]) ^ zobrist(ZOBRIST_REGISTERS + i, after[i]);
+}
+#endif
+
+void Chip8::write_bcd(uint16_t addr, uint8_t value) {
+    uint8_t bcd[3] = { (uint8_t)(value / 100), (uint8_t)(value / 10 % 10), (uint8_t)(value % 10) };
+    write_memory(addr, bcd, 3);
+}
+
+uint8_t* Chip8::own_page(unsigned p, bool overwrite) {
+    if ((pool_pages & (1 << p)) && page_refs(pages[p]).load(std::memory_order_acquire) == 1) {
+        writable_pages |= 1 << p; // forks that shared it are gone
+        return (uint8_t*)pages[p];
+    }
+
+    // first write to a page of the boot image or one shared with a fork, copy it unless all
+    // of it is about to be replaced
+    uint8_t* page = acquire_page();
+    if (!overwrite)
+        memcpy(page, pages[p], PAGE_SIZE);
+    if (pool_pages & (1 << p))
+        release_page(pages[p]);
+
+    pages[p] = page;
+    pool_pages |= 1 << p;
+    writable_pages |= 1 << p;
+    code_base = NO_CODE_PAGE;
+    return page;
+}
+
+size_t Chip8::private_memory() const {
+    size_t count = 0;
+    for (unsigned p = 0; p < PAGES; p++)
+        if ((pool_pages & (1 << p)) && page_refs(pages[p]).load(std::memory_order_relaxed) == 1)
+            count++;
+
+    return count * PAGE_SIZE;
+}
+
+void Chip8::reset() {
+    boot_state = pristine_state(); // no ROM any more
+    boot();
+}
+
+void Chip8::reset_keep_rom() {
+    boot();
+}
+
+void Chip8::seed(uint32_t value) {
+    REGISTERS_CHANGING();
+    rng_state = value ^ 0x9E3779B9; // xorshift state must never be 0
+    if (rng_state == 0)
+        rng_state = 1;
+    REGISTERS_CHANGED();
+}
+
+void Chip8::set_key(uint8_t key, bool pressed) {
+    REGISTERS_CHANGING();
+    uint16_t bit = 1 << (key & 0xF);
+    keys = pressed ? keys | bit : keys & ~bit;
+    REGISTERS_CHANGED();
+}
+
+void Chip8::set_keys(uint16_t mask) {
+    REGISTERS_CHANGING();
+    keys = mask;
+    REGISTERS_CHANGED();
+}
 
-    // load fontset in memory
-    uint16_t fontset_start_addr = 0x050;
-    for (int i = 0; i < 16; i++)
-        for (int j = 0; j < 5; j++)
-            memory[fontset_start_addr + i*5 + j] = fontset[i][j];
+void Chip8::save_state(Chip8State& state) const {
+    static_cast<Chip8Core&>(state) = *this;
 
-    srand(time(NULL));
+    for (unsigned p = 0; p < PAGES; p++)
+        memcpy(state.memory + p * PAGE_SIZE, pages[p], PAGE_SIZE);
+}
+
+void Chip8::load_state(const Chip8State& state) {
+    static_cast<Chip8Core&>(*this) = state;
+
+    // pages equal to the boot image stay shared, only the others are copied
+    for (unsigned p = 0; p < PAGES; p++) {
+        const uint8_t* shared = boot_state->memory + p * PAGE_SIZE;
+        const uint8_t* wanted = state.memory + p * PAGE_SIZE;
+
+        if (memcmp(wanted, shared, PAGE_SIZE) == 0) {
+            if (pool_pages & (1 << p))
+                release_page(pages[p]);
+            pages[p] = shared;
+            pool_pages &= ~(1 << p);
+            writable_pages &= ~(1 << p);
+            code_base = NO_CODE_PAGE;
+        } else {
+            memcpy(own_page(p, true), wanted, PAGE_SIZE);
+        }
+    }
+
+#ifdef CHIP8_ZOBRIST
+    zobrist_hash = hash_state(state);
+#endif
+    draw_flag = true; // display may have changed
 }
 
 bool Chip8::load_rom(std::string path) {
     if (path.empty()) return false;
 
+    if (path == "-") {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        return load_rom(std::cin);
+    }
+
     std::ifstream rom(path, std::ios_base::binary);
     if (!rom) {
         std::cout << "Cannot open a file" << std::endl;
         return false;
     }
 
-    uint16_t addr = 0x200; // start address in memory
-    char ch;
-    while (rom.read(&ch, 1)) {
-        if (addr > 4096)
-            return false;
+    return load_rom(rom);
+}
 
-        uint8_t byte = (uint8_t)ch;
-        memory[addr++] = byte; // write byte to memory
+bool Chip8::load_rom(std::istream& in) {
+    // one byte more than fits tells a too large rom apart without knowing the size up front,
+    // which pipes do not
+    uint8_t bytes[MAX_ROM_SIZE + 1];
+    in.read((char*)bytes, sizeof(bytes));
+    size_t size = (size_t)in.gcount();
+
+    if (size > MAX_ROM_SIZE) {
+        std::cout << "Rom is larger than " << MAX_ROM_SIZE << " bytes" << std::endl;
+        return false;
     }
 
+    return load_rom(bytes, size);
+}
+
+bool Chip8::load_rom(const uint8_t* data, size_t size) {
+    if (size > MAX_ROM_SIZE)
+        return false;
+
+    // new boot image is the current state with the program at 0x200, shared by copies of this machine
+    auto image = std::make_shared<Chip8BootImage>();
+    save_state(*image);
+    memcpy(image->memory + 0x200, data, size);
+#ifdef CHIP8_ZOBRIST
+    image->hash = hash_state(*image);
+#endif
+
+    boot_state = image;
+    boot();
     return true;
 }
 
 void Chip8::single_cycle() {
-    uint16_t op = (memory[pc] << 8) | memory[pc + 1]; // reading operation code
+    // reading operation code through the page pc was in last time, which saves the page table
+    // lookup; the opcode crosses into the next page only when pc is the last byte of one
+    uint16_t at = pc & 0xFFF;
+    if ((unsigned)(at - code_base) >= PAGE_SIZE - 1) {
+        code_base = at & ~(PAGE_SIZE - 1);
+        code_page = pages[at / PAGE_SIZE];
+    }
+    uint16_t op = at % PAGE_SIZE != PAGE_SIZE - 1 ? (code_page[at % PAGE_SIZE] << 8) | code_page[at % PAGE_SIZE + 1]
+                                                  : (MEM(at) << 8) | MEM((at + 1) & 0xFFF);
 
     uint16_t addr;
     uint8_t reg, reg1, reg2, val;
@@ -107,10 +633,16 @@ void Chip8::single_cycle() {
             switch (op) {
                 case 0x00E0:
                     // 00E0 - clear the display
+#ifdef CHIP8_ZOBRIST
+                    zobrist_hash ^= display_hash();
+#endif
                     memset(display, 0, sizeof(display));
+#ifdef CHIP8_ZOBRIST
+                    zobrist_hash ^= display_hash();
+#endif
                     draw_flag = true;
 
-                    pc += 2;
+                    pc = (pc + 2) & 0xFFF;
                     break;
 
                 case 0x00EE:
@@ -120,7 +652,7 @@ void Chip8::single_cycle() {
                         pc = stack[sp];
                     }
 
-                    pc += 2;
+                    pc = (pc + 2) & 0xFFF;
                     break;
             }
 
@@ -151,9 +683,9 @@ void Chip8::single_cycle() {
             val = op & 0x00FF;
 
             if (v[reg] == val)
-                pc += 2;
+                pc = (pc + 2) & 0xFFF;
             
-            pc += 2;
+            pc = (pc + 2) & 0xFFF;
             break;
 
         case 4:
@@ -162,9 +694,9 @@ void Chip8::single_cycle() {
             val = op & 0x00FF;
 
             if (v[reg] != val)
-                pc += 2;
+                pc = (pc + 2) & 0xFFF;
             
-            pc += 2;
+            pc = (pc + 2) & 0xFFF;
             break;
 
         case 5:
@@ -173,9 +705,9 @@ void Chip8::single_cycle() {
             reg2 = (op & 0x00F0) >> 4;
 
             if (v[reg1] == v[reg2])
-                pc += 2;
+                pc = (pc + 2) & 0xFFF;
             
-            pc += 2;
+            pc = (pc + 2) & 0xFFF;
             break;
 
         case 6:
@@ -185,7 +717,7 @@ void Chip8::single_cycle() {
 
             v[reg] = val;
 
-            pc += 2;
+            pc = (pc + 2) & 0xFFF;
             break;
 
         case 7:
@@ -195,7 +727,7 @@ void Chip8::single_cycle() {
 
             v[reg] += val;
 
-            pc += 2;
+            pc = (pc + 2) & 0xFFF;
             break;
 
         case 8:
@@ -208,7 +740,7 @@ void Chip8::single_cycle() {
 
                     v[reg1] = v[reg2];
 
-                    pc += 2;
+                    pc = (pc + 2) & 0xFFF;
                     break;
 
                 case 1:
@@ -219,7 +751,7 @@ void Chip8::single_cycle() {
                     v[reg1] = v[reg1] | v[reg2];
                     v[0xF] = 0;
 
-                    pc += 2;
+                    pc = (pc + 2) & 0xFFF;
                     break;
 
                 case 2:
@@ -230,7 +762,7 @@ void Chip8::single_cycle() {
                     v[reg1] = v[reg1] & v[reg2];
                     v[0xF] = 0;
 
-                    pc += 2;
+                    pc = (pc + 2) & 0xFFF;
                     break;
 
                 case 3:
@@ -241,7 +773,7 @@ void Chip8::single_cycle() {
                     v[reg1] = v[reg1] ^ v[reg2];
                     v[0xF] = 0;
 
-                    pc += 2;
+                    pc = (pc + 2) & 0xFFF;
                     break;
 
                 case 4:
@@ -259,7 +791,7 @@ void Chip8::single_cycle() {
                     else
                         v[0xF] = 0;
 
-                    pc += 2;
+                    pc = (pc + 2) & 0xFFF;
                     break;
 
                 case 5:
@@ -275,7 +807,7 @@ void Chip8::single_cycle() {
                     else
                         v[0xF] = 1;
 
-                    pc += 2;
+                    pc = (pc + 2) & 0xFFF;
                     break;
 
                 case 6:
@@ -283,12 +815,13 @@ void Chip8::single_cycle() {
                     reg1 = (op & 0x0F00) >> 8;
                     reg2 = (op & 0x00F0) >> 4;
 
-                    v[reg1] = v[reg2];
+                    if (!(quirk_flags & QUIRK_SHIFT))
+                        v[reg1] = v[reg2];
                     temp = (uint16_t)(v[reg1] & 0x01);
                     v[reg1] >>= 1;
                     v[0xF] = (uint8_t)temp;
 
-                    pc += 2;
+                    pc = (pc + 2) & 0xFFF;
                     break;
 
                 case 7:
@@ -303,7 +836,7 @@ void Chip8::single_cycle() {
                     else
                         v[0xF] = 1;
 
-                    pc += 2;
+                    pc = (pc + 2) & 0xFFF;
                     break;
 
                 case 14:
@@ -312,12 +845,13 @@ void Chip8::single_cycle() {
                     reg1 = (op & 0x0F00) >> 8;
                     reg2 = (op & 0x00F0) >> 4;
 
-                    v[reg1] = v[reg2];
+                    if (!(quirk_flags & QUIRK_SHIFT))
+                        v[reg1] = v[reg2];
                     temp = (uint16_t)(v[reg1] >> 7);
                     v[reg1] <<= 1;
                     v[0xF] = (uint8_t)temp;
 
-                    pc += 2;
+                    pc = (pc + 2) & 0xFFF;
                     break;
             }
 
@@ -329,9 +863,9 @@ void Chip8::single_cycle() {
             reg2 = (op & 0x00F0) >> 4;
 
             if (v[reg1] != v[reg2])
-                pc += 2;
+                pc = (pc + 2) & 0xFFF;
 
-            pc += 2;
+            pc = (pc + 2) & 0xFFF;
             break;
 
         case 10:
@@ -339,13 +873,14 @@ void Chip8::single_cycle() {
             addr = op & 0x0FFF;
             index = addr;
 
-            pc += 2;
+            pc = (pc + 2) & 0xFFF;
             break;
         
         case 11:
-            // BNNN - Jumps to the address NNN plus V0
+            // BNNN - Jumps to the address NNN plus V0, or XNN plus VX with QUIRK_JUMP
             addr = op & 0x0FFF;
-            pc = addr + v[0];
+            reg = quirk_flags & QUIRK_JUMP ? (op & 0x0F00) >> 8 : 0;
+            pc = (addr + v[reg]) & 0xFFF;
 
             break;
 
@@ -354,12 +889,16 @@ void Chip8::single_cycle() {
             reg = (op & 0x0F00) >> 8;
             mask = op & 0x00FF;
 
-            rnd = rand() % 0x100; // between 0 and 256
+            // xorshift32, every instance has its own generator
+            rng_state ^= rng_state << 13;
+            rng_state ^= rng_state >> 17;
+            rng_state ^= rng_state << 5;
+            rnd = rng_state >> 24; // between 0 and 256
             rnd &= mask;
 
             v[reg] = rnd;
 
-            pc += 2;
+            pc = (pc + 2) & 0xFFF;
             break;
 
         case 13: {
@@ -367,36 +906,35 @@ void Chip8::single_cycle() {
             reg1 = (op & 0x0F00) >> 8; // register where X coordinate is stored
             reg2 = (op & 0x00F0) >> 4; // register where Y coorfinate is stored
             uint8_t height = op & 0x000F; // N
-            uint8_t width = 8; // every sprite is 8 pixels wide
 
             // read coordinates
-            int x = v[reg1];
+            int x = v[reg1] % 64;
             int y = v[reg2];
 
             v[0xF] = 0;  // Reset collision flag
 
             for (int i = 0; i < height; i++) {
-                uint8_t pixel = memory[index + i];
+                // whole sprite row placed on the display row, wrapped around the right edge
+                uint64_t row = sprite_row(MEM((index + i) & 0xFFF), x);
+                uint64_t& line = display[(y + i) % 32];
 
-                for (int j = 0; j < width; j++) {
-                    if ((pixel & (0x80 >> j)) != 0) {
-                        // calculate coorinates
-                        int xpos = (x + j) % 64;
-                        int ypos = (y + i) % 32;
+#ifdef CHIP8_ZOBRIST
+                zobrist_hash ^= zobrist(ZOBRIST_DISPLAY + (y + i) % 32, line) ^ zobrist(ZOBRIST_DISPLAY + (y + i) % 32, line ^ row);
+#endif
 
-                        // if pixel was changed from set to unset, set collision flag
-                        if (display[ypos][xpos] == 1)
-                            v[0xF] = 1;
+                // if any pixel was changed from set to unset, set collision flag
+                if (line & row)
+                    v[0xF] = 1;
 
-                        // xoring
-                        display[ypos][xpos] ^= 1;
-                    }
-                }
+                // xoring
+                line ^= row;
             }
 
             // set draw flag
             draw_flag = true;
-            pc += 2;
+            draw_count++;
+            collision_count += v[0xF];
+            pc = (pc + 2) & 0xFFF;
             break;
         }
 
@@ -407,19 +945,19 @@ void Chip8::single_cycle() {
                     // EX9E - Skips the next instruction if the key stored in VX is pressed
                     reg = (op & 0x0F00) >> 8; // key
 
-                    if (keyboard[v[reg]] == 1)
-                        pc += 2;
+                    if ((keys >> (v[reg] & 0xF)) & 1)
+                        pc = (pc + 2) & 0xFFF;
                         
-                    pc += 2;
+                    pc = (pc + 2) & 0xFFF;
                     break;
 
                 case 0xA1:
                     // EXA1 - Skips the next instruction if the key stored in VX is not pressed
                     reg = (op & 0x0F00) >> 8; // key
-                    if (keyboard[v[reg]] == 0)
-                        pc += 2;
+                    if (((keys >> (v[reg] & 0xF)) & 1) == 0)
+                        pc = (pc + 2) & 0xFFF;
 
-                    pc += 2;
+                    pc = (pc + 2) & 0xFFF;
                     break;
             }
 
@@ -433,7 +971,7 @@ void Chip8::single_cycle() {
                     reg = (op & 0x0F00) >> 8;
                     v[reg] = delay_timer;
 
-                    pc += 2;
+                    pc = (pc + 2) & 0xFFF;
                     break;
                 }
 
@@ -445,14 +983,14 @@ void Chip8::single_cycle() {
                     bool key_pressed = false;
 
                     for (int i = 0; i < 16; i++) {
-                        if (keyboard[i]) {
+                        if ((keys >> i) & 1) {
                             key_pressed = true;
                             v[reg] = (uint8_t)i;
                         }
                     }
 
                     if (key_pressed)
-                        pc += 2;
+                        pc = (pc + 2) & 0xFFF;
 
                     break;
                 }
@@ -462,7 +1000,7 @@ void Chip8::single_cycle() {
                     reg = (op & 0x0F00) >> 8;
                     delay_timer = v[reg];
 
-                    pc += 2;
+                    pc = (pc + 2) & 0xFFF;
                     break;
                 }
 
@@ -471,7 +1009,7 @@ void Chip8::single_cycle() {
                     reg = (op & 0x0F00) >> 8;
                     sound_timer = v[reg];
 
-                    pc += 2;
+                    pc = (pc + 2) & 0xFFF;
                     break;
                 }
 
@@ -481,16 +1019,16 @@ void Chip8::single_cycle() {
                     
                     index = (uint16_t)(index + v[reg]);
 
-                    pc += 2;
+                    pc = (pc + 2) & 0xFFF;
                     break;
                 }
 
                 case 0x29: {
                     // FX29 - Sets I to the location of the sprite for the character in VX
                     reg = (op & 0x0F00) >> 8;
-                    index = 0x050 + v[reg] * 0x5; // each char is 5 locations long
+                    index = FONT_ADDRESS + v[reg] * 0x5; // each char is 5 locations long
 
-                    pc += 2;
+                    pc = (pc + 2) & 0xFFF;
                     break;
                 }
 
@@ -501,11 +1039,8 @@ void Chip8::single_cycle() {
                     reg = (op & 0x0F00) >> 8;
 
                     // 255 -> memory[index] = 2, memory[index + 1] = 5, memory[index + 2] = 5
-                    memory[index] = (uint8_t)(v[reg] / 100);
-                    memory[index + 1] = (uint8_t)((uint8_t)(v[reg] / 10) % 10);
-                    memory[index + 2] = (uint8_t)(v[reg] % 10);
-
-                    pc += 2;
+                    pc = (pc + 2) & 0xFFF;
+                    write_bcd(index & 0xFFF, v[reg]); // last, so it compiles to a jump
                     break;
                 }
 
@@ -513,13 +1048,12 @@ void Chip8::single_cycle() {
                     // FX55 - Stores from V0 to VX (including VX) in memory, starting at address I
                     reg = (op & 0x0F00) >> 8;
 
-                    for (int i = 0; i <= reg; i++) {
-                        memory[index + i] = v[i];
-                    }
+                    addr = index & 0xFFF;
+                    if (!(quirk_flags & QUIRK_LOAD_STORE))
+                        index = (uint16_t)(index + reg + 1);
+                    pc = (pc + 2) & 0xFFF;
 
-                    index = (uint16_t)(index + reg + 1);
-                    
-                    pc += 2;
+                    write_memory(addr, v, reg + 1); // last, so it compiles to a jump
                     break;
                 }
 
@@ -527,12 +1061,12 @@ void Chip8::single_cycle() {
                     // FX65 - Fills from V0 to VX (including VX) with values from memory, starting at address I
                     reg = (op & 0x0F00) >> 8;
 
-                    for (int i = 0; i <= reg; i++)
-                        v[i] = memory[index + i];
-
-                    index = (uint16_t)(index + reg + 1);
+                    addr = index & 0xFFF;
+                    if (!(quirk_flags & QUIRK_LOAD_STORE))
+                        index = (uint16_t)(index + reg + 1);
+                    pc = (pc + 2) & 0xFFF;
 
-                    pc += 2;
+                    read_memory(v, addr, reg + 1); // last, so it compiles to a jump
                     break;
                 }
             }
@@ -540,71 +1074,46 @@ void Chip8::single_cycle() {
             break;
         }
     }
+}
+
+void Chip8::step(unsigned cycles) {
+    execute(cycles, false);
+}
+
+void Chip8::execute(unsigned cycles, bool frame) {
+    uint64_t draws = draw_count;
+    uint64_t collisions = collision_count;
+
+    // the register words are hashed again once for the whole run, nothing reads the hash
+    // between its instructions
+    REGISTERS_CHANGING();
+    for (unsigned i = 0; i < cycles; i++)
+        single_cycle();
+    REGISTERS_CHANGED();
+    if (frame)
+        tick_timers(); // timers run at 60Hz, once per frame
+
+    // into the thread's counters once per call rather than per instruction
+    ThreadMetrics& metrics = thread_metrics();
+    metrics.add(METRIC_INSTRUCTIONS, cycles);
+    metrics.add(METRIC_FRAMES, frame);
+    metrics.add(METRIC_DRAWS, draw_count - draws);
+    metrics.add(METRIC_COLLISIONS, collision_count - collisions);
+}
 
+void Chip8::tick_timers() {
+    REGISTERS_CHANGING();
     // decreasing timers
     if (delay_timer > 0) delay_timer--;
     if (sound_timer > 0) sound_timer--;
+    REGISTERS_CHANGED();
 }
 
-void Chip8::emulate() {
-    SDL_Init(SDL_INIT_VIDEO); // initializing SDL
-
-    SDL_Window* window = SDL_CreateWindow("CHIP8", 640, 320, 0); // creating a window
-
-    SDL_Renderer* renderer = SDL_CreateRenderer(window, NULL); // createing a window renderer
-
-    bool running = true;
-    SDL_Event event;
-
-    const int PIXEL_SIZE = 10; // upcale 1 pixel to 10 for bigger picture
-    while (running) {
-        while (SDL_PollEvent(&event)) {
-            if (event.type == SDL_EVENT_QUIT) // if close button pressed
-                running = false;
-
-            if (event.type == SDL_EVENT_KEY_DOWN) {
-                for (int i = 0; i < 16; i++)
-                    if (event.key.scancode == keymap[i])
-                        keyboard[i] = 1;
-            }
-
-            if (event.type == SDL_EVENT_KEY_UP) {
-                for (int i = 0; i < 16; i++)
-                    if (event.key.scancode == keymap[i])
-                        keyboard[i] = 0;
-            }
-        }
-
-        if (!running) break;
-
-        single_cycle(); // emulate one cycle
-
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-        SDL_RenderClear(renderer);
-
-        // draw pixels
-        if (draw_flag) {
-            for (int y = 0; y < 32; y++) {
-                for (int x = 0; x < 64; x++) {
-                    if (display[y][x] == 1)
-                        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255); // white
-                    else
-                        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255); // black
-
-                    SDL_FRect rect = { (float)(x * PIXEL_SIZE), (float)(y * PIXEL_SIZE), PIXEL_SIZE, PIXEL_SIZE }; // create rectangle
-                    SDL_RenderFillRect(renderer, &rect); // draw rectangle
-                }
-            }
-
-            draw_flag = false; // reset drawing flag
-            SDL_RenderPresent(renderer);
-        }
-
-        SDL_Delay(2);
-    }
+void Chip8::run_frame(unsigned cycles) {
+    execute(cycles, true);
+}
 
-    // Destroy all SDL components
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
-    SDL_Quit();
-}
\ No newline at end of file
+void Chip8::run_frames(unsigned frames) {
+    for (unsigned f = 0; f < frames; f++)
+        run_frame();
+}
@@ -4,34 +4,155 @@
 #include <iostream>
 #include <cstdint>
 #include <cstring>
+#include <memory>
 
-class Chip8 {
-private:
-    uint8_t memory[4096]; // 4KB of memory
-    bool display[32][64]; // monochomatic 32x64 diplsay
-    bool draw_flag; // not to rerender if display did not change
+class RomLibrary;
 
+// registers and display, the part of the machine every instance keeps to itself, laid out
+// for the cache: the registers touched by every instruction share the first cache line
+struct Chip8Core {
+    alignas(64) uint8_t v[16]; // V0-VF general purpose registers
     uint16_t pc; // program counter
     uint16_t index; // index register
-
     uint16_t stack[16]; // stack
     uint8_t sp; // stack pointer
 
-    uint8_t v[16]; // V0-VF general purpose registers
-
     uint8_t delay_timer;
     uint8_t sound_timer;
 
-    bool keyboard[16]; // keyboard array
+    uint16_t keys; // keyboard, bit per pressed key
+    uint32_t rng_state; // random number generator for CXNN
+
+    uint64_t display[32]; // monochomatic 32x64 diplsay, one row per word with the leftmost pixel in the top bit
+};
+
+// complete machine state in a flat layout, used to compare and transfer machines
+struct Chip8State : Chip8Core {
+    uint8_t memory[4096]; // 4KB of memory
+};
+
+// state a machine boots into, shared by every machine running the same ROM
+struct Chip8BootImage : Chip8State {
+    uint64_t hash; // Chip8::hash_state() of the image, worked out once in CHIP8_ZOBRIST builds
+};
+
+// Memory is split into pages which point into the image the machine booted from (the state
+// right after the ROM was loaded, shared by every machine running that ROM). The first
+// write to a page gives the machine its own copy of it (copy-on-write). Copies and forks
+// share those copies too, until one of them writes to the page.
+class Chip8 : private Chip8Core {
+private:
+    static const unsigned PAGE_SIZE = 256;
+    static const unsigned PAGES = 4096 / PAGE_SIZE;
+
+    const uint8_t* pages[PAGES]; // memory, read through the page of the address
+    static const uint16_t NO_CODE_PAGE = 0xF000; // code_base when code_page must be looked up again
+
+    const uint8_t* code_page; // page pc was in at the last fetch
+    uint16_t code_base; // address of the first byte of code_page
+    uint16_t pool_pages; // bit per page taken from the page pool, possibly shared with forks, the others belong to boot_state
+    mutable uint16_t writable_pages; // bit per pool page known to be referenced by this machine alone, cleared by copying it
+    uint8_t quirk_flags; // QUIRK_ bits the instructions follow
+    bool draw_flag; // not to rerender if display did not change
+    unsigned frame_cycles; // instructions per frame of run_frame()
+
+    // statistics for the metrics, kept through resets and not part of Chip8State
+    uint64_t draw_count; // DXYN executed
+    uint64_t collision_count; // DXYN that turned a pixel off
 
+    std::shared_ptr<const Chip8BootImage> boot_state; // state right after the ROM was loaded, backs the shared pages
+
+#ifdef CHIP8_ZOBRIST
+    uint64_t zobrist_hash; // hash_state() of the current state, updated by every write
+
+    uint64_t memory_hash(uint16_t addr, unsigned count) const; // part of the hash covering a memory range
+    uint64_t display_hash() const; // part of the hash covering the display
+    void rehash_registers(const uint64_t* before); // updates the hash for registers changed since before
+#endif
+
+    void boot(); // restores boot_state
+    void release_pages(); // drops all private pages
+    uint8_t* own_page(unsigned p, bool overwrite = false); // copies a shared page before the first write to it, not when overwrite replaces all of it
+    void write_memory(uint16_t addr, const uint8_t* src, unsigned count); // up to a page, wraps at 4KB
+    void write_pages(uint16_t addr, const uint8_t* src, unsigned count); // write_memory() through own_page()
+    void read_memory(uint8_t* dst, uint16_t addr, unsigned count) const; // up to a page, wraps at 4KB
+    void write_bcd(uint16_t addr, uint8_t value); // decimal digits of value, hundreds first
 
     void single_cycle(); // emulates single cycle of the CPU
+    void execute(unsigned cycles, bool frame); // step() and, for a frame, the timers; counts the work in the metrics
 public:
+    static const unsigned CYCLES_PER_FRAME = 10; // instructions executed per 60Hz frame unless set otherwise
+
+    // behaviours where later interpreters differ from the COSMAC VIP, a bit each, none set
+    // runs every instruction as the original did
+    enum Quirk : uint8_t {
+        QUIRK_SHIFT = 1, // 8XY6 and 8XYE shift VX in place instead of VY into VX
+        QUIRK_LOAD_STORE = 2, // FX55 and FX65 leave I unchanged
+        QUIRK_JUMP = 4, // BXNN jumps to XNN plus VX instead of NNN plus V0
+    };
+
     Chip8(); // constructor
+    Chip8(const Chip8& other); // shares all memory pages, copies only the registers and display; not thread safe for the same other
+    Chip8& operator=(const Chip8& other);
+    ~Chip8();
+
+    // machines on the heap come from a pool, a discarded fork hands its block to the next one
+    static void* operator new(size_t size);
+    static void operator delete(void* machine, size_t size);
+
+    std::unique_ptr<Chip8> fork() const; // child machine continuing from the current state, for tree search
+
+    static const unsigned MAX_ROM_SIZE = 4096 - 0x200; // program space from 0x200 to the end of memory
+    static const uint16_t FONT_ADDRESS = 0x050; // where every machine has the hex digit sprites
+    static const uint8_t FONT[16][5]; // 4x5 sprites of the hex digits, in the top nibble of each byte
+
+    bool load_rom(std::string path); // loading the rom file, "-" is standard input, pipes and FIFOs work too
+    bool load_rom(std::istream& in); // loading the rom from the rest of a stream, one bulk read
+    bool load_rom(const uint8_t* data, size_t size); // loading the rom from a memory buffer
+
+    void reset(); // back to the state right after construction, ROM is unloaded
+    void reset_keep_rom(); // back to the state right after the ROM was loaded, a single copy
+
+    size_t private_memory() const; // bytes of memory owned by this machine alone
+
+    // settings of the program rather than state, kept by resets and copies, not part of Chip8State
+    void set_quirks(uint8_t mask) { quirk_flags = mask; }
+    uint8_t quirks() const { return quirk_flags; }
+    void set_cycles_per_frame(unsigned cycles) { frame_cycles = cycles; }
+    unsigned cycles_per_frame() const { return frame_cycles; }
+
+    void seed(uint32_t value); // seeds random number generator, same seed gives the same run
+    void set_key(uint8_t key, bool pressed); // presses or releases key 0-F
+    void set_keys(uint16_t mask); // sets all keys, bit per pressed key
+
+    void step(unsigned cycles); // emulates number of cycles without touching the timers
+    void tick_timers(); // decreases delay and sound timers
+    void run_frame() { run_frame(frame_cycles); } // emulates one 60Hz frame
+    void run_frame(unsigned cycles); // emulates one 60Hz frame of the given number of instructions
+    void run_frames(unsigned frames); // emulates frames one after another with the same keys, for frame skipping
+
+    void save_state(Chip8State& state) const; // copies whole machine state out
+    void load_state(const Chip8State& state); // replaces whole machine state
+
+    const uint64_t* framebuffer() const { return display; } // 32 packed display rows
+
+    // single fields of the state, for reading game state without copying it out
+    uint8_t peek(uint16_t addr) const { return pages[(addr & 0xFFF) / PAGE_SIZE][addr % PAGE_SIZE]; } // memory byte, wraps at 4KB
+    uint8_t reg(uint8_t x) const { return v[x & 0xF]; } // register VX
+    uint16_t program_counter() const { return pc; }
+    uint8_t stack_pointer() const { return sp; } // entries on the call stack
+    uint64_t sprites_drawn() const { return draw_count; } // DXYN executed since construction, copied with the machine
+    uint64_t collisions() const { return collision_count; } // DXYN of those that turned a pixel off
 
-    bool load_rom(std::string); // loading the rom file
+    static uint64_t hash_state(const Chip8State& state); // 64-bit Zobrist hash of a whole machine state
+#ifdef CHIP8_ZOBRIST
+    uint64_t state_hash() const { return zobrist_hash; } // hash_state() of the current state, kept up to date as it runs
+#endif
 
-    void emulate(); // emulate the process
+    // emulate the process, rom_path is the loaded ROM, the start of ROM switching through
+    // library, the opened index of its directory (./roms for standard input); run_ahead
+    // frames are emulated past every frame to show it, and thrown away
+    void emulate(const std::string& rom_path, RomLibrary& library, unsigned run_ahead = 0);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include "chip8_c.h"
+#include "chip8.h"
+
+#include <new>
+
+// the handle is the machine itself, no wrapper object in between
+static Chip8* machine_of(chip8* machine) {
+    return reinterpret_cast<Chip8*>(machine);
+}
+
+static const Chip8* machine_of(const chip8* machine) {
+    return reinterpret_cast<const Chip8*>(machine);
+}
+
+uint32_t chip8_api_version(void) {
+    return CHIP8_API_VERSION;
+}
+
+chip8* chip8_create(void) {
+    try {
+        return reinterpret_cast<chip8*>(new Chip8);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+// releasing pages and machines never throws, so neither does destroying or resetting
+void chip8_destroy(chip8* machine) {
+    delete machine_of(machine);
+}
+
+int chip8_load_rom(chip8* machine, const uint8_t* data, size_t size) {
+    try {
+        return machine_of(machine)->load_rom(data, size);
+    } catch (const std::bad_alloc&) {
+        return 0;
+    }
+}
+
+void chip8_reset(chip8* machine) {
+    machine_of(machine)->reset_keep_rom();
+}
+
+void chip8_seed(chip8* machine, uint32_t seed) {
+    machine_of(machine)->seed(seed);
+}
+
+void chip8_set_keys(chip8* machine, uint16_t mask) {
+    machine_of(machine)->set_keys(mask);
+}
+
+int chip8_step(chip8* machine, unsigned cycles) {
+    try {
+        machine_of(machine)->step(cycles);
+        return 1;
+    } catch (const std::bad_alloc&) {
+        return 0;
+    }
+}
+
+void chip8_tick_timers(chip8* machine) {
+    machine_of(machine)->tick_timers();
+}
+
+int chip8_run_frame(chip8* machine) {
+    try {
+        machine_of(machine)->run_frame();
+        return 1;
+    } catch (const std::bad_alloc&) {
+        return 0;
+    }
+}
+
+int chip8_run_frames(chip8* machine, unsigned frames) {
+    try {
+        machine_of(machine)->run_frames(frames);
+        return 1;
+    } catch (const std::bad_alloc&) {
+        return 0;
+    }
+}
+
+const uint64_t* chip8_framebuffer(const chip8* machine) {
+    return machine_of(machine)->framebuffer();
+}
+
+size_t chip8_state_size(void) {
+    return sizeof(Chip8State);
+}
+
+// the caller's buffer has no alignment guarantee, states go through an aligned copy
+void chip8_save_state(const chip8* machine, void* state) {
+    Chip8State copy;
+    machine_of(machine)->save_state(copy);
+    memcpy(state, &copy, sizeof(copy));
+}
+
+int chip8_load_state(chip8* machine, const void* state) {
+    Chip8State copy;
+    memcpy(&copy, state, sizeof(copy));
+
+    try {
+        machine_of(machine)->load_state(copy);
+        return 1;
+    } catch (const std::bad_alloc&) {
+        return 0;
+    }
+}
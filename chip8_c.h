@@ -0,0 +1,60 @@
+#ifndef CHIP8_C_H
+#define CHIP8_C_H
+
+/* C interface to the emulator core, built as libchip8.so and libchip8.a. Everything goes
+   through an opaque machine handle, functions only add or remove entries at the end of this
+   file and CHIP8_API_VERSION counts the changes. A machine must only be used by one thread
+   at a time, different machines can run on different threads. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32) && defined(CHIP8_BUILD_LIBRARY)
+#define CHIP8_API __declspec(dllexport)
+#elif defined(__GNUC__)
+#define CHIP8_API __attribute__((visibility("default")))
+#else
+#define CHIP8_API
+#endif
+
+#define CHIP8_API_VERSION 2
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct chip8 chip8;
+
+CHIP8_API uint32_t chip8_api_version(void); /* CHIP8_API_VERSION the library was built with */
+
+CHIP8_API chip8* chip8_create(void); /* NULL when out of memory */
+CHIP8_API void chip8_destroy(chip8* machine); /* never fails */
+
+/* copies the program to 0x200 and restarts, 0 when it does not fit or out of memory */
+CHIP8_API int chip8_load_rom(chip8* machine, const uint8_t* data, size_t size);
+CHIP8_API void chip8_reset(chip8* machine); /* back to the state right after the ROM was loaded, never fails */
+CHIP8_API void chip8_seed(chip8* machine, uint32_t seed); /* same seed gives the same run */
+
+CHIP8_API void chip8_set_keys(chip8* machine, uint16_t mask); /* bit per pressed key 0-F */
+
+/* running returns 0 when a write to memory ran out of memory, the machine stopped inside an
+   instruction then and has to be reset or loaded from a snapshot before running on */
+CHIP8_API int chip8_step(chip8* machine, unsigned cycles); /* instructions, timers are not touched */
+CHIP8_API void chip8_tick_timers(chip8* machine); /* one 60Hz tick of the delay and sound timers */
+CHIP8_API int chip8_run_frame(chip8* machine); /* one 60Hz frame, instructions and a timer tick */
+CHIP8_API int chip8_run_frames(chip8* machine, unsigned frames);
+
+/* 32 rows of 64 pixels, one row per word with the leftmost pixel in the top bit; points
+   into the machine and stays valid until it is destroyed */
+CHIP8_API const uint64_t* chip8_framebuffer(const chip8* machine);
+
+/* snapshots are chip8_state_size() bytes, only valid for a library of the same version */
+CHIP8_API size_t chip8_state_size(void);
+CHIP8_API void chip8_save_state(const chip8* machine, void* state);
+CHIP8_API int chip8_load_state(chip8* machine, const void* state); /* 0 when out of memory */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,132 @@
+#include "exporter.h"
+
+#include <cstdio>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    const struct {
+        const char* name;
+        const char* help;
+    } counter_info[METRIC_COUNTERS] = {
+        { "chip8_instructions_total", "Instructions executed by all machines, the shadow machines of run-ahead excluded." },
+        { "chip8_frames_emulated_total", "Frames emulated by all machines, the shadow machines of run-ahead excluded." },
+        { "chip8_frames_presented_total", "Frames shown by the frontend." },
+        { "chip8_draws_total", "DXYN instructions executed." },
+        { "chip8_collisions_total", "DXYN instructions that turned a pixel off." },
+        { "chip8_frames_dropped_total", "Frame periods the frontend missed." },
+    };
+
+    bool write_file(const std::string& path, const std::string& text) {
+        std::string temporary = path + ".tmp";
+        FILE* file = fopen(temporary.c_str(), "wb");
+        if (file == NULL)
+            return false;
+
+        bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+        ok = fclose(file) == 0 && ok;
+#ifdef _WIN32
+        remove(path.c_str()); // rename does not replace on Windows
+#endif
+        return ok && rename(temporary.c_str(), path.c_str()) == 0;
+    }
+
+    bool write_socket(const std::string& path, const std::string& text) {
+#ifdef _WIN32
+        (void)path;
+        (void)text;
+        return false;
+#else
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path))
+            return false;
+        path.copy(address.sun_path, path.size());
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return false;
+
+        bool ok = connect(fd, (const sockaddr*)&address, sizeof(address)) == 0;
+        for (size_t sent = 0; ok && sent < text.size();) {
+#ifdef MSG_NOSIGNAL
+            ssize_t n = send(fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+#else
+            ssize_t n = send(fd, text.data() + sent, text.size() - sent, 0);
+#endif
+            ok = n > 0;
+            sent += ok ? (size_t)n : 0;
+        }
+
+        close(fd);
+        return ok;
+#endif
+    }
+}
+
+
+MetricsExporter::MetricsExporter(const std::string& target, uint64_t interval) : target(target), interval(interval) {
+}
+
+bool MetricsExporter::poll(uint64_t now, const TimeHistogram* frame_times) {
+    if (last_time == 0) {
+        last_time = now;
+        last_instructions = metric_total(METRIC_INSTRUCTIONS);
+        return true;
+    }
+
+    if (now - last_time < interval)
+        return true;
+    return write(now, frame_times);
+}
+
+bool MetricsExporter::write(uint64_t now, const TimeHistogram* frame_times) {
+    std::string text = format(now, frame_times);
+    if (target.compare(0, 5, "unix:") == 0)
+        return write_socket(target.substr(5), text);
+    return write_file(target, text);
+}
+
+std::string MetricsExporter::format(uint64_t now, const TimeHistogram* frame_times) {
+    std::string text;
+    char line[96];
+
+    for (int c = 0; c < METRIC_COUNTERS; c++) {
+        std::string name = counter_info[c].name;
+        text += "# HELP " + name + " " + counter_info[c].help + "\n# TYPE " + name + " counter\n";
+        text += name + " " + std::to_string(metric_total((MetricCounter)c)) + "\n";
+    }
+
+    // rate since the previous write
+    uint64_t instructions = metric_total(METRIC_INSTRUCTIONS);
+    double seconds = last_time != 0 && now > last_time ? (now - last_time) / 1e9 : 0;
+    text += "# HELP chip8_instructions_per_second Instructions executed a second since the previous export.\n"
+            "# TYPE chip8_instructions_per_second gauge\n";
+    snprintf(line, sizeof(line), "chip8_instructions_per_second %.1f\n",
+             seconds > 0 ? (instructions - last_instructions) / seconds : 0.0);
+    text += line;
+    last_time = now;
+    last_instructions = instructions;
+
+    if (frame_times != nullptr && frame_times->count() > 0) {
+        text += "# HELP chip8_frame_time_seconds Host frame times since start, quantile 1 is the longest frame.\n"
+                "# TYPE chip8_frame_time_seconds summary\n";
+        const double quantiles[] = { 0.5, 0.9, 0.99 };
+        for (double q : quantiles) {
+            snprintf(line, sizeof(line), "chip8_frame_time_seconds{quantile=\"%g\"} %.6f\n", q,
+                     frame_times->percentile(q * 100) / 1e9);
+            text += line;
+        }
+        snprintf(line, sizeof(line), "chip8_frame_time_seconds{quantile=\"1\"} %.6f\n", frame_times->max() / 1e9);
+        text += line;
+        snprintf(line, sizeof(line), "chip8_frame_time_seconds_sum %.6f\n", frame_times->sum() / 1e9);
+        text += line;
+        text += "chip8_frame_time_seconds_count " + std::to_string(frame_times->count()) + "\n";
+    }
+
+    return text;
+}
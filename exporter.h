@@ -0,0 +1,31 @@
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include "histogram.h"
+#include "metrics.h"
+
+#include <string>
+
+// Writes all counters, instructions a second and a frame time summary in the Prometheus text
+// format. The target is a file, replaced through a rename so readers never see half of it
+// (the node exporter's textfile collector reads these), or unix:<path>, a listening stream
+// socket that gets a connection with the text every time.
+class MetricsExporter {
+public:
+    MetricsExporter(const std::string& target, uint64_t interval); // interval in ns
+
+    // now in ns of a monotonic clock, writes when interval has passed since the last write;
+    // frame_times are the host frame times when there are any
+    bool poll(uint64_t now, const TimeHistogram* frame_times = nullptr);
+    bool write(uint64_t now, const TimeHistogram* frame_times = nullptr); // right away
+
+    std::string format(uint64_t now, const TimeHistogram* frame_times); // text of one write
+
+private:
+    std::string target;
+    uint64_t interval;
+    uint64_t last_time = 0; // 0 before the first poll
+    uint64_t last_instructions = 0;
+};
+
+#endif
@@ -0,0 +1,284 @@
+#include "chip8.h"
+#include "exporter.h"
+#include "hud.h"
+#include "latency.h"
+#include "metrics.h"
+#include "pacer.h"
+#include "render.h"
+#include "romloader.h"
+
+#include <filesystem>
+#include <vector>
+
+#include <SDL3/SDL.h>
+
+// mapping keycodes with indexes
+const uint8_t keymap[16] = {
+    SDL_SCANCODE_1,
+    SDL_SCANCODE_2,
+    SDL_SCANCODE_3,
+    SDL_SCANCODE_4,
+    SDL_SCANCODE_Q,
+    SDL_SCANCODE_W,
+    SDL_SCANCODE_E,
+    SDL_SCANCODE_R,
+    SDL_SCANCODE_A,
+    SDL_SCANCODE_S,
+    SDL_SCANCODE_D,
+    SDL_SCANCODE_F,
+    SDL_SCANCODE_Z,
+    SDL_SCANCODE_X,
+    SDL_SCANCODE_C,
+    SDL_SCANCODE_V
+};
+
+void Chip8::emulate(const std::string& rom_path, RomLibrary& library, unsigned run_ahead) {
+    SDL_Init(SDL_INIT_VIDEO); // initializing SDL
+
+    SDL_Window* window = SDL_CreateWindow("CHIP8", 640, 320, 0); // creating a window
+
+    SDL_Renderer* renderer = SDL_CreateRenderer(window, NULL); // createing a window renderer
+
+    // display is uploaded as a 64x32 texture and upscaled by the renderer, the rows below it
+    // hold the HUD and are shown with it
+    SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_XRGB8888, SDL_TEXTUREACCESS_STREAMING, 64, 32 + Hud::HEIGHT);
+    SDL_SetTextureScaleMode(texture, SDL_SCALEMODE_NEAREST); // keep pixels sharp
+    SDL_Log("Expanding the display with %s kernels", simd_level_name(simd_level()));
+
+    // ROMs of the directory the running one is in, Page Up and Page Down switch between them
+    // and a file dropped on the window replaces the running one; only the machine is
+    // reloaded, SDL stays as it is
+    std::unique_ptr<AsyncRomLoader> loader(new AsyncRomLoader); // its queue is SDL's, released before SDL_Quit()
+
+    // a ROM from standard input switches to the roms folder
+    std::filesystem::path rom = rom_path == "-" ? std::filesystem::path("./roms/-") : std::filesystem::path(rom_path);
+    if (rom_path != "-")
+        SDL_SetWindowTitle(window, ("CHIP8 - " + rom.stem().string()).c_str());
+
+    // input to photon latency of key presses, F2 shows it over the display
+    LatencyProbe latency;
+    bool show_latency = false;
+
+    // performance figures below the display, F1 shows them
+    Hud hud;
+    bool show_hud = false;
+    bool hud_changed = false;
+
+    auto switch_rom = [&](const std::filesystem::path& path) {
+        Uint64 start = SDL_GetTicksNS();
+
+        // the file is read before anything is reset, so a ROM that cannot be loaded leaves
+        // the running game as it is
+        std::vector<uint8_t> bytes;
+        bool read = false;
+        read_roms({ path.string() }, [&](size_t, const uint8_t* data, size_t size) {
+            read = data != nullptr;
+            if (read)
+                bytes.assign(data, data + size);
+        });
+        if (!read) {
+            SDL_Log("Cannot load %s, keeping the running ROM", path.string().c_str());
+            return;
+        }
+
+        // settings from the index of the ROM's directory; a directory that cannot be indexed
+        // or a file the index leaves out (not a .ch8 or .c8) gets them from the database
+        // of known ROMs, or the defaults
+        RomSettings settings;
+        std::string dir = path.has_parent_path() ? path.parent_path().string() : ".";
+        const RomLibrary::Entry* entry = nullptr;
+        if (!library.open(dir, loader->reader()))
+            SDL_Log("Cannot index %s, running %s without its index entry", dir.c_str(), path.filename().string().c_str());
+        else if ((entry = library.find(path.filename().string(), loader->reader())) == nullptr)
+            SDL_Log("%s is not in the index of %s, running it without its index entry", path.filename().string().c_str(), dir.c_str());
+
+        if (entry != nullptr)
+            settings = entry->settings;
+        else
+            find_known_rom(RomHash::of(bytes.data(), bytes.size()), settings); // defaults when unknown
+
+        latency.cancel();
+        reset(); // nothing of the previous game carries over into the new boot image
+        load_rom(bytes.data(), bytes.size());
+        settings.apply(*this);
+        seed((uint32_t)SDL_GetTicksNS());
+
+        rom = path;
+        SDL_SetWindowTitle(window, ("CHIP8 - " + rom.stem().string()).c_str());
+        SDL_Log("Switched to %s in %.2f ms", rom.filename().string().c_str(), (SDL_GetTicksNS() - start) / 1e6);
+    };
+
+    // next or previous ROM of the library, which is sorted by name
+    auto cycle_rom = [&](int direction) {
+        size_t count = library.size();
+        if (count == 0)
+            return;
+
+        std::string current = rom.filename().string();
+        size_t at = 0;
+        while (at < count && library.name(library[at]) < current)
+            at++;
+
+        size_t next;
+        if (at < count && library.name(library[at]) == current)
+            next = (at + count + direction) % count;
+        else
+            next = direction > 0 ? at % count : (at + count - 1) % count; // between two names
+        switch_rom(rom.parent_path() / library.name(library[next]));
+    };
+
+    bool running = true;
+    SDL_Event event;
+    FramePacer pacer; // 60 emulated frames a second
+    Chip8 ahead; // snapshot run ahead of the machine, reused every frame
+    if (run_ahead > 0)
+        SDL_Log("Running %u frames ahead", run_ahead);
+
+    // CHIP8_METRICS is a file or unix:<socket> for Prometheus metrics, written every
+    // CHIP8_METRICS_INTERVAL seconds, 10 unless set
+    std::unique_ptr<MetricsExporter> metrics;
+    if (const char* target = SDL_getenv("CHIP8_METRICS")) {
+        const char* interval = SDL_getenv("CHIP8_METRICS_INTERVAL");
+        double seconds = interval ? SDL_atof(interval) : 10;
+        metrics.reset(new MetricsExporter(target, (Uint64)((seconds > 0 ? seconds : 10) * SDL_NS_PER_SECOND)));
+        SDL_Log("Writing metrics to %s", target);
+    }
+
+    while (running) {
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_EVENT_QUIT) // if close button pressed
+                running = false;
+
+            if (event.type == SDL_EVENT_DROP_FILE)
+                switch_rom(event.drop.data);
+
+            if (event.type == SDL_EVENT_KEY_DOWN && !event.key.repeat) {
+                if (event.key.scancode == SDL_SCANCODE_PAGEDOWN)
+                    cycle_rom(1);
+                if (event.key.scancode == SDL_SCANCODE_PAGEUP)
+                    cycle_rom(-1);
+                if (event.key.scancode == SDL_SCANCODE_F1) {
+                    show_hud = !show_hud;
+                    hud_changed = draw_flag = true;
+                }
+                if (event.key.scancode == SDL_SCANCODE_F2) {
+                    show_latency = !show_latency;
+                    draw_flag = true;
+                }
+            }
+
+            // the probe sees the machine before the key changes, held keys repeating change nothing
+            if ((event.type == SDL_EVENT_KEY_DOWN || event.type == SDL_EVENT_KEY_UP) && !event.key.repeat) {
+                for (int i = 0; i < 16; i++)
+                    if (event.key.scancode == keymap[i])
+                        latency.key(*this, i, event.type == SDL_EVENT_KEY_DOWN, event.key.timestamp);
+            }
+
+            if (event.type == SDL_EVENT_KEY_DOWN) {
+                for (int i = 0; i < 16; i++)
+                    if (event.key.scancode == keymap[i])
+                        set_key(i, true);
+            }
+
+            if (event.type == SDL_EVENT_KEY_UP) {
+                for (int i = 0; i < 16; i++)
+                    if (event.key.scancode == keymap[i])
+                        set_key(i, false);
+            }
+        }
+
+        if (!running) break;
+
+        run_frame(); // the instructions of one frame, as many as the ROM wants
+
+        // with run-ahead the frame shown is the one run_ahead frames later with the keys held
+        // now, from a snapshot that shares all memory pages; the machine itself never runs it
+        const uint64_t* shown = display;
+        if (run_ahead > 0) {
+            MetricsSuspension shadow; // frames the machine runs again later, counted then
+            ahead = *this;
+            ahead.run_frames(run_ahead);
+            shown = ahead.display;
+            draw_flag |= ahead.draw_flag;
+        }
+        if (latency.frame(shown, run_ahead))
+            draw_flag = true; // present the response even when only the machine without the press drew
+        if (hud.frame(*this, SDL_GetTicksNS()) && show_hud)
+            hud_changed = draw_flag = true;
+
+        // draw pixels
+        if (draw_flag) {
+            void* pixels;
+            int pitch;
+            const SDL_Rect screen = { 0, 0, 64, 32 };
+            if (SDL_LockTexture(texture, &screen, &pixels, &pitch)) {
+                expand_framebuffer(shown, pixels, pitch, 0xFFFFFFFF, 0xFF000000); // white on black
+                SDL_UnlockTexture(texture);
+            }
+
+            const SDL_Rect strip = { 0, 32, Hud::WIDTH, Hud::HEIGHT };
+            if (hud_changed && show_hud && SDL_LockTexture(texture, &strip, &pixels, &pitch)) {
+                hud.draw(pixels, pitch);
+                SDL_UnlockTexture(texture);
+                hud_changed = false;
+            }
+
+            // the display, with the HUD below it when shown, as large as fits the window with
+            // square pixels
+            int width = 640, height = 320;
+            SDL_GetCurrentRenderOutputSize(renderer, &width, &height);
+            SDL_FRect source = { 0, 0, 64, (float)(show_hud ? 32 + Hud::HEIGHT : 32) };
+            float scale = SDL_min(width / source.w, height / source.h);
+            SDL_FRect target = { (width - source.w * scale) / 2, (height - source.h * scale) / 2, source.w * scale, source.h * scale };
+
+            SDL_RenderClear(renderer);
+            SDL_RenderTexture(renderer, texture, &source, &target);
+
+            if (show_latency) {
+                const TimeHistogram& latencies = latency.latencies();
+                SDL_RenderDebugTextFormat(renderer, 4, 4, "input latency %.1f ms  p50 %.1f  p99 %.1f  max %.1f  (%llu)",
+                                          latency.last_latency() / 1e6, latencies.percentile(50) / 1e6,
+                                          latencies.percentile(99) / 1e6, latencies.max() / 1e6,
+                                          (unsigned long long)latencies.count());
+            }
+
+            draw_flag = false; // reset drawing flag
+            SDL_RenderPresent(renderer);
+            latency.presented(SDL_GetTicksNS());
+            count_metric(METRIC_PRESENTED);
+        }
+
+        pacer.wait();
+
+        if (metrics && !metrics->poll(SDL_GetTicksNS(), &pacer.frame_times()))
+            SDL_Log("Could not write metrics to %s", SDL_getenv("CHIP8_METRICS"));
+    }
+
+    if (metrics)
+        metrics->write(SDL_GetTicksNS(), &pacer.frame_times()); // the last frames too
+
+    // CHIP8_FRAME_TIMES names a file for the whole frame time histogram
+    pacer.log_summary();
+    const char* histogram = SDL_getenv("CHIP8_FRAME_TIMES");
+    if (histogram && !pacer.write_histogram(histogram))
+        SDL_Log("Could not write frame times to %s", histogram);
+
+    // and CHIP8_LATENCY one for the input latencies
+    const TimeHistogram& latencies = latency.latencies();
+    if (latencies.count() > 0)
+        SDL_Log("Input latency over %llu presses: p50 %.1f ms, p99 %.1f ms, max %.1f ms, %llu without effect",
+                (unsigned long long)latencies.count(), latencies.percentile(50) / 1e6, latencies.percentile(99) / 1e6,
+                latencies.max() / 1e6, (unsigned long long)latency.dropped());
+    const char* latency_file = SDL_getenv("CHIP8_LATENCY");
+    if (latency_file && !latency.write(latency_file))
+        SDL_Log("Could not write input latencies to %s", latency_file);
+
+    // the ROM loader goes first, its queue belongs to SDL
+    loader.reset();
+
+    // Destroy all SDL components
+    SDL_DestroyTexture(texture);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+}
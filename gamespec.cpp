@@ -0,0 +1,217 @@
+#include "gamespec.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+static bool parse_number(const std::string& text, long& number) {
+    if (text.empty())
+        return false;
+
+    char* end;
+    number = strtol(text.c_str(), &end, 0);
+    return *end == '\0';
+}
+
+static int bit_count(unsigned value) {
+    int count = 0;
+    for (; value != 0; value &= value - 1)
+        count++;
+    return count;
+}
+
+bool GameSpec::load(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        message = "cannot open " + path;
+        return false;
+    }
+
+    std::stringstream text;
+    text << file.rdbuf();
+    return parse(text.str());
+}
+
+int GameSpec::find(const std::string& name) const {
+    for (size_t i = 0; i < sources.size(); i++)
+        if (sources[i].name == name)
+            return (int)i;
+    return -1;
+}
+
+bool GameSpec::parse(const std::string& text) {
+    sources.clear();
+    rewards.clear();
+    dones.clear();
+    message.clear();
+
+    std::istringstream lines(text);
+    std::string line;
+    for (int number = 1; std::getline(lines, line); number++) {
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream in(line);
+        std::vector<std::string> words;
+        for (std::string word; in >> word;)
+            words.push_back(word);
+        if (words.empty())
+            continue;
+
+        std::string where = "line " + std::to_string(number) + ": ";
+        long a = 0, b = 0;
+
+        if (words[0] == "value" && words.size() >= 3) {
+            Source source = { words[1], PC, 0, 0, false };
+            if (find(source.name) >= 0) {
+                message = where + "value " + source.name + " defined twice";
+                return false;
+            }
+
+            size_t next;
+            if (words[2] == "mem" && words.size() >= 4 && parse_number(words[3], a) && a >= 0 && a < 4096) {
+                source.kind = MEM;
+                next = 4;
+            } else if (words[2] == "bcd" && words.size() >= 5 && parse_number(words[3], a) && a >= 0 && a < 4096 &&
+                       parse_number(words[4], b) && b >= 1 && b <= 9) {
+                source.kind = BCD;
+                source.digits = (uint8_t)b;
+                next = 5;
+            } else if (words[2] == "reg" && words.size() >= 4 && parse_number(words[3], a) && a >= 0 && a < 16) {
+                source.kind = REG;
+                next = 4;
+            } else if (words[2] == "pc") {
+                source.kind = PC;
+                next = 3;
+            } else {
+                message = where + "bad value source";
+                return false;
+            }
+            source.addr = (uint16_t)a;
+
+            if (next < words.size() && words[next] == "bits") {
+                source.bits = true;
+                next++;
+            }
+            if (next != words.size()) {
+                message = where + "unexpected " + words[next];
+                return false;
+            }
+
+            sources.push_back(source);
+        } else if (words[0] == "reward" && words.size() >= 3) {
+            Reward reward;
+            int value = find(words[1]);
+            char* end;
+            reward.scale = strtof(words[2].c_str(), &end);
+            reward.direction = 0;
+            reward.conditional = false;
+
+            size_t next = 3;
+            if (next < words.size() && (words[next] == "up" || words[next] == "down"))
+                reward.direction = words[next++] == "up" ? 1 : -1;
+            if (next < words.size() && words[next] == "when") {
+                reward.conditional = true;
+                if (!parse_condition(words, next + 1, reward.when))
+                    next = 0; // bad condition
+                else
+                    next += 4;
+            }
+
+            if (value < 0 || *end != '\0' || next != words.size()) {
+                message = where + "bad reward";
+                return false;
+            }
+
+            reward.value = value;
+            rewards.push_back(reward);
+        } else if (words[0] == "done" && words.size() == 4) {
+            Condition done;
+            if (!parse_condition(words, 1, done)) {
+                message = where + "bad done";
+                return false;
+            }
+
+            dones.push_back(done);
+        } else {
+            message = where + "unknown command " + words[0];
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// <name> <op> <number> starting at words[first]
+bool GameSpec::parse_condition(const std::vector<std::string>& words, size_t first, Condition& condition) const {
+    static const char* const ops[] = { "==", "!=", "<", "<=", ">", ">=" };
+
+    if (first + 3 > words.size())
+        return false;
+
+    int value = find(words[first]);
+    int op = -1;
+    for (int i = 0; i < 6; i++)
+        if (words[first + 1] == ops[i])
+            op = i;
+
+    long operand;
+    if (value < 0 || op < 0 || !parse_number(words[first + 2], operand))
+        return false;
+
+    condition.value = value;
+    condition.op = (Op)op;
+    condition.operand = (int32_t)operand;
+    return true;
+}
+
+bool GameSpec::holds(const Condition& condition, int32_t value) {
+    switch (condition.op) {
+        case EQ: return value == condition.operand;
+        case NE: return value != condition.operand;
+        case LT: return value < condition.operand;
+        case LE: return value <= condition.operand;
+        case GT: return value > condition.operand;
+        case GE: return value >= condition.operand;
+    }
+    return false;
+}
+
+int32_t GameSpec::read(const Chip8& chip8, const Source& source) const {
+    int32_t value = 0;
+    switch (source.kind) {
+        case MEM: value = chip8.peek(source.addr); break;
+        case REG: value = chip8.reg(source.addr); break;
+        case PC: value = chip8.program_counter(); break;
+        case BCD:
+            for (unsigned i = 0; i < source.digits; i++)
+                value = value * 10 + chip8.peek(source.addr + i);
+            break;
+    }
+
+    return source.bits ? bit_count((uint32_t)value) : value;
+}
+
+void GameSpec::sample(const Chip8& chip8, int32_t* out) const {
+    for (size_t i = 0; i < sources.size(); i++)
+        out[i] = read(chip8, sources[i]);
+}
+
+bool GameSpec::update(const Chip8& chip8, int32_t* last, float& reward) const {
+    for (const Reward& r : rewards) {
+        int32_t change = read(chip8, sources[r.value]) - last[r.value];
+        if (change * r.direction < 0)
+            continue;
+        if (r.conditional && !(holds(r.when, last[r.when.value]) && holds(r.when, read(chip8, sources[r.when.value]))))
+            continue;
+
+        reward += r.scale * change;
+    }
+
+    sample(chip8, last);
+
+    bool over = false;
+    for (const Condition& done : dones)
+        over |= holds(done, last[done.value]);
+
+    return over;
+}
@@ -0,0 +1,76 @@
+#ifndef GAMESPEC_H
+#define GAMESPEC_H
+
+#include "chip8.h"
+
+#include <string>
+#include <vector>
+
+// Score and game over of a ROM, read from the machine state by a spec file. One command per
+// line, numbers in C notation (0x2F3 or 755), # starts a comment:
+//   value <name> mem <addr> [bits]           byte at addr
+//   value <name> bcd <addr> <digits> [bits]  decimal number, one digit per byte with the most
+//                                            significant first, as written by FX33
+//   value <name> reg <x> [bits]              register VX
+//   value <name> pc                          program counter
+//   reward <name> <scale> [up|down] [when <name> <op> <number>]
+//                                            reward is scale times the change of the value,
+//                                            up or down counts only changes in that direction,
+//                                            when only changes while the condition held before
+//                                            and after them
+//   done <name> <op> <number>                game is over while the value compares true, op is
+//                                            one of == != < <= > >=, several done lines are or-ed
+// bits makes the value the number of set bits instead of the number.
+//
+// Specs are parsed once into plain accessors, evaluating one is a few loads per value.
+class GameSpec {
+public:
+    bool load(const std::string& path); // false and error() set when the file cannot be used
+    bool parse(const std::string& text);
+    const std::string& error() const { return message; }
+
+    unsigned values() const { return (unsigned)sources.size(); }
+
+    void sample(const Chip8& chip8, int32_t* out) const; // current value of every value
+    // samples the values, adds the reward for their change since the last sample to reward and
+    // returns whether the game is over
+    bool update(const Chip8& chip8, int32_t* last, float& reward) const;
+
+private:
+    enum Kind { MEM, BCD, REG, PC };
+    enum Op { EQ, NE, LT, LE, GT, GE };
+
+    struct Source {
+        std::string name;
+        Kind kind;
+        uint16_t addr; // memory address, or register number
+        uint8_t digits;
+        bool bits;
+    };
+
+    struct Condition {
+        unsigned value;
+        Op op;
+        int32_t operand;
+    };
+
+    struct Reward {
+        unsigned value;
+        float scale;
+        int direction; // 0 for every change, 1 only increases, -1 only decreases
+        bool conditional;
+        Condition when;
+    };
+
+    std::vector<Source> sources;
+    std::vector<Reward> rewards;
+    std::vector<Condition> dones;
+    std::string message;
+
+    int32_t read(const Chip8& chip8, const Source& source) const;
+    int find(const std::string& name) const;
+    bool parse_condition(const std::vector<std::string>& words, size_t first, Condition& condition) const;
+    static bool holds(const Condition& condition, int32_t value);
+};
+
+#endif
@@ -0,0 +1,39 @@
+#include "histogram.h"
+
+#include <algorithm>
+
+void TimeHistogram::add(uint64_t ns) {
+    size_t bucket = (size_t)(ns / BUCKET_NS);
+    buckets[bucket < BUCKETS ? bucket : BUCKETS - 1]++;
+    total++;
+    total_ns += ns;
+    if (ns > longest)
+        longest = ns;
+}
+
+void TimeHistogram::clear() {
+    std::fill(buckets.begin(), buckets.end(), 0);
+    total = 0;
+    total_ns = 0;
+    longest = 0;
+}
+
+uint64_t TimeHistogram::percentile(double p) const {
+    if (total == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)(p / 100 * (total - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank)
+            return i + 1 < BUCKETS ? std::min<uint64_t>((i + 1) * BUCKET_NS, longest) : longest;
+    }
+    return longest;
+}
+
+void TimeHistogram::write(FILE* file) const {
+    for (size_t i = 0; i < BUCKETS; i++)
+        if (buckets[i] != 0)
+            fprintf(file, "%llu %u\n", (unsigned long long)(i * BUCKET_NS / 1000), (unsigned)buckets[i]);
+}
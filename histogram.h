@@ -0,0 +1,34 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Durations in nanoseconds, counted in 10 us buckets up to 100 ms; the last bucket counts
+// everything longer. Percentiles are exact to a bucket, the maximum is exact.
+class TimeHistogram {
+public:
+    static const uint64_t BUCKET_NS = 10000;
+    static const size_t BUCKETS = 10000;
+
+    TimeHistogram() : buckets(BUCKETS) {}
+
+    void add(uint64_t ns);
+    void clear();
+
+    uint64_t count() const { return total; }
+    uint64_t sum() const { return total_ns; } // of all durations added, exact
+    uint64_t max() const { return longest; }
+    uint64_t percentile(double p) const; // upper end of the bucket holding it, 0 when empty
+
+    void write(FILE* file) const; // "<bucket start in us> <count>" lines, nonempty buckets only
+
+private:
+    std::vector<uint32_t> buckets;
+    uint64_t total = 0;
+    uint64_t total_ns = 0;
+    uint64_t longest = 0;
+};
+
+#endif
@@ -0,0 +1,131 @@
+#include "hud.h"
+#include "metrics.h"
+
+#include <cstdio>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace {
+    const uint32_t BACKGROUND = 0xFF000000;
+    const uint32_t SEPARATOR = 0xFF404040;
+    const uint32_t INSTRUCTIONS_COLOR = 0xFFFFFFFF;
+    const uint32_t FRAMES_COLOR = 0xFF80FF80;
+    const uint32_t FRAME_TIME_COLOR = 0xFFFFFF80;
+    const uint32_t SPRITES_COLOR = 0xFF80C0FF;
+    const uint32_t CPU_COLOR = 0xFFFF8080;
+
+    const int GLYPH_ADVANCE = 5; // 4 pixels of the glyph and a blank column
+    const int DOT_ADVANCE = 2;
+    const int LINE_Y[3] = { 2, 8, 14 }; // first row of each line of text, row 0 is the separator
+
+    uint64_t process_cpu_ns() {
+#ifdef _WIN32
+        FILETIME created, exited, kernel, user;
+        if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user))
+            return 0;
+        uint64_t k = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+        uint64_t u = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+        return (k + u) * 100; // 100 ns units
+#else
+        timespec t;
+        if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t) != 0)
+            return 0;
+        return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+#endif
+    }
+
+    int text_width(const char* text) {
+        int width = 0;
+        for (; *text; text++)
+            width += *text == '.' ? DOT_ADVANCE : GLYPH_ADVANCE;
+        return width - 1; // no blank column after the last glyph
+    }
+
+    // digits and A-F from the font, a dot as a single pixel on the baseline
+    void draw_text(uint8_t* strip, int pitch, int x, int y, const char* text, uint32_t color) {
+        for (; *text; text++) {
+            char c = *text;
+            if (c == '.') {
+                if (x >= 0 && x < Hud::WIDTH)
+                    ((uint32_t*)(strip + (y + 4) * pitch))[x] = color;
+                x += DOT_ADVANCE;
+                continue;
+            }
+
+            int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+            if (digit >= 0) {
+                for (int row = 0; row < 5; row++) {
+                    uint32_t* line = (uint32_t*)(strip + (y + row) * pitch);
+                    for (int col = 0; col < 4; col++)
+                        if ((Chip8::FONT[digit][row] & (0x80 >> col)) && x + col >= 0 && x + col < Hud::WIDTH)
+                            line[x + col] = color;
+                }
+            }
+            x += GLYPH_ADVANCE;
+        }
+    }
+}
+
+bool Hud::frame(const Chip8& machine, uint64_t now) {
+    if (window_start == 0) {
+        window_start = previous_frame = now;
+        sprites_at_start = machine.sprites_drawn();
+        instructions_at_start = metric_total(METRIC_INSTRUCTIONS);
+        cpu_at_start = process_cpu_ns();
+        return false;
+    }
+
+    frames++;
+    if (now - previous_frame > longest_frame)
+        longest_frame = now - previous_frame;
+    previous_frame = now;
+
+    uint64_t elapsed = now - window_start;
+    if (elapsed < 1000000000)
+        return false;
+
+    uint64_t sprites = machine.sprites_drawn() - sprites_at_start;
+    uint64_t instructions = metric_total(METRIC_INSTRUCTIONS); // what ran, whatever the settings say
+    uint64_t cpu = process_cpu_ns();
+    instructions_per_second = (instructions - instructions_at_start) * 1000000000 / elapsed;
+    frames_per_second = (unsigned)((frames * 1000000000 + elapsed / 2) / elapsed);
+    frame_time = (unsigned)((longest_frame + 50000) / 100000);
+    sprites_per_frame = (unsigned)((sprites * 10 + frames / 2) / frames);
+    cpu_percent = (unsigned)((cpu - cpu_at_start) * 100 / elapsed);
+
+    window_start = now;
+    longest_frame = 0;
+    frames = 0;
+    sprites_at_start = machine.sprites_drawn();
+    instructions_at_start = instructions;
+    cpu_at_start = cpu;
+    return true;
+}
+
+void Hud::draw(void* pixels, int pitch) const {
+    uint8_t* strip = (uint8_t*)pixels;
+    for (int y = 0; y < HEIGHT; y++) {
+        uint32_t* line = (uint32_t*)(strip + y * pitch);
+        for (int x = 0; x < WIDTH; x++)
+            line[x] = y == 0 ? SEPARATOR : BACKGROUND;
+    }
+
+    char text[24];
+    snprintf(text, sizeof(text), "%llu", (unsigned long long)instructions_per_second);
+    draw_text(strip, pitch, 1, LINE_Y[0], text, INSTRUCTIONS_COLOR);
+
+    snprintf(text, sizeof(text), "%u", frames_per_second);
+    draw_text(strip, pitch, 1, LINE_Y[1], text, FRAMES_COLOR);
+    snprintf(text, sizeof(text), "%u.%u", frame_time / 10, frame_time % 10);
+    draw_text(strip, pitch, WIDTH - 1 - text_width(text), LINE_Y[1], text, FRAME_TIME_COLOR);
+
+    snprintf(text, sizeof(text), "%u.%u", sprites_per_frame / 10, sprites_per_frame % 10);
+    draw_text(strip, pitch, 1, LINE_Y[2], text, SPRITES_COLOR);
+    snprintf(text, sizeof(text), "%u", cpu_percent);
+    draw_text(strip, pitch, WIDTH - 1 - text_width(text), LINE_Y[2], text, CPU_COLOR);
+}
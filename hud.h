@@ -0,0 +1,43 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include "chip8.h"
+
+#include <cstdint>
+
+// Performance figures of the running machine, drawn with the machine's own 4x5 hex font into
+// a strip of HEIGHT rows below the 64x32 display, so it goes into the same texture and draw
+// as the display. Figures are averaged over a second and shown in three lines:
+//   instructions a second, all machines of the process as counted in the metrics
+//   emulated frames a second            longest host frame of the second, ms
+//   sprites drawn (DXYN) a frame        CPU time of the process, % of one core
+class Hud {
+public:
+    static const int WIDTH = 64;
+    static const int HEIGHT = 19;
+
+    // once a host frame after the machine ran a frame, now in ns of a monotonic clock; true
+    // when a second has passed and the figures changed
+    bool frame(const Chip8& machine, uint64_t now);
+
+    // the strip, HEIGHT rows of WIDTH 32-bit pixels, pitch is the row length in bytes
+    void draw(void* pixels, int pitch) const;
+
+private:
+    uint64_t window_start = 0; // 0 before the first frame
+    uint64_t previous_frame = 0;
+    uint64_t longest_frame = 0;
+    uint64_t frames = 0;
+    uint64_t sprites_at_start = 0;
+    uint64_t instructions_at_start = 0; // metric_total(METRIC_INSTRUCTIONS)
+    uint64_t cpu_at_start = 0;
+
+    // figures of the last whole second
+    uint64_t instructions_per_second = 0;
+    unsigned frames_per_second = 0;
+    unsigned frame_time = 0; // tenths of a ms
+    unsigned sprites_per_frame = 0; // tenths
+    unsigned cpu_percent = 0;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#include "latency.h"
+#include "metrics.h"
+
+#include <cstdio>
+
+void LatencyProbe::key(const Chip8& machine, uint8_t key, bool pressed, uint64_t time) {
+    if (pressed_at == 0) {
+        if (!pressed)
+            return;
+
+        control = machine;
+        measured_key = key;
+        pressed_at = time;
+        frames = 0;
+        responded = false;
+        return;
+    }
+
+    if (key != measured_key)
+        control.set_key(key, pressed);
+}
+
+bool LatencyProbe::frame(const uint64_t* shown, unsigned run_ahead) {
+    if (pressed_at == 0 || responded)
+        return responded;
+
+    MetricsSuspension shadow; // the frames of the game are counted by the machine itself
+    control.run_frame();
+    const uint64_t* expected = control.framebuffer();
+    if (run_ahead > 0) {
+        ahead = control;
+        ahead.run_frames(run_ahead);
+        expected = ahead.framebuffer();
+    }
+
+    if (memcmp(shown, expected, 32 * sizeof(uint64_t)) != 0) {
+        responded = true;
+    } else if (++frames >= TIMEOUT_FRAMES) {
+        pressed_at = 0;
+        timeouts++;
+    }
+    return responded;
+}
+
+void LatencyProbe::presented(uint64_t time) {
+    if (pressed_at == 0 || !responded)
+        return;
+
+    last = time > pressed_at ? time - pressed_at : 0;
+    samples.add(last);
+    pressed_at = 0;
+}
+
+void LatencyProbe::cancel() {
+    pressed_at = 0;
+}
+
+bool LatencyProbe::write(const std::string& path) const {
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == NULL)
+        return false;
+
+    fprintf(file, "# presses %llu\n", (unsigned long long)samples.count());
+    fprintf(file, "# dropped %llu\n", (unsigned long long)timeouts);
+    fprintf(file, "# p50_us %llu\n", (unsigned long long)(samples.percentile(50) / 1000));
+    fprintf(file, "# p99_us %llu\n", (unsigned long long)(samples.percentile(99) / 1000));
+    fprintf(file, "# max_us %llu\n", (unsigned long long)(samples.max() / 1000));
+    samples.write(file);
+    return fclose(file) == 0;
+}
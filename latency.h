@@ -0,0 +1,48 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "chip8.h"
+#include "histogram.h"
+
+#include <string>
+
+// Measures input to photon latency: from the timestamp of a key press to the first present
+// showing a frame the press changed. Whether a frame changed because of the press is decided
+// by a control machine, a snapshot taken just before the press that runs the same frames
+// without it. The first frame where the displays of the two differ is the response. Other
+// key changes while a press is measured go to the control machine as well, so the press is
+// the only difference.
+class LatencyProbe {
+public:
+    static const unsigned TIMEOUT_FRAMES = 120; // a press with no visible effect by then is dropped
+
+    // before a key of the machine changes, time in the clock the present time is given in
+    void key(const Chip8& machine, uint8_t key, bool pressed, uint64_t time);
+
+    // after the machine ran a frame, shown is the display about to be presented, run_ahead
+    // frames past the machine; true when it is the response to the press being measured
+    bool frame(const uint64_t* shown, unsigned run_ahead);
+
+    void presented(uint64_t time); // records the latency when the frame presented was a response
+    void cancel(); // the machine was replaced, forget the press being measured
+
+    const TimeHistogram& latencies() const { return samples; }
+    uint64_t last_latency() const { return last; }
+    uint64_t dropped() const { return timeouts; } // presses without a visible effect
+
+    bool write(const std::string& path) const; // summary and histogram, "#" before the summary lines
+
+private:
+    Chip8 control; // the machine as it would be without the press
+    Chip8 ahead; // control run ahead as far as the frame shown
+    uint8_t measured_key;
+    uint64_t pressed_at = 0; // 0 when no press is being measured
+    unsigned frames = 0; // run since the press
+    bool responded = false;
+
+    TimeHistogram samples;
+    uint64_t last = 0;
+    uint64_t timeouts = 0;
+};
+
+#endif
@@ -1,6 +1,11 @@
+#include <climits>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <string>
 #include "chip8.h"
+#include "romloader.h"
 
 using namespace std;
 
@@ -10,13 +15,64 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    // --scan [dir] indexes a ROM directory and lists it
+    if (string(argv[1]) == "--scan") {
+        RomLibrary library;
+        AsyncRomLoader loader;
+        string dir = argc > 2 ? argv[2] : "./roms";
+        if (!library.scan(dir, loader.reader())) {
+            cerr << "Cannot index " << dir << endl;
+            return 1;
+        }
+
+        for (size_t i = 0; i < library.size(); i++) {
+            const RomLibrary::Entry& entry = library[i];
+            RomSettings settings;
+            const char* title = "unknown";
+            find_known_rom(entry.hash, settings, &title);
+
+            cout << entry.hash.hex() << "  " << entry.settings.cycles_per_frame << " cycles  quirks "
+                 << (unsigned)entry.settings.quirks << "  " << library.name(entry) << "  (" << title << ")" << endl;
+        }
+        return 0;
+    }
+
+    // --run-ahead N before the ROM shows every frame as it will be N frames later
+    int arg = 1;
+    unsigned run_ahead = 0;
+    if (string(argv[1]) == "--run-ahead") {
+        char* end = nullptr;
+        unsigned long frames = argc > 2 ? strtoul(argv[2], &end, 10) : 0;
+        if (argc < 4 || end == argv[2] || *end != '\0' || argv[2][0] == '-' || frames > UINT_MAX) {
+            cerr << "Usage: " << argv[0] << " --run-ahead N rom, N a number of frames" << endl;
+            return 1;
+        }
+        run_ahead = (unsigned)frames;
+        arg = 3;
+    }
+
     Chip8 chip8;
 
-    std::string rom_path = "./roms/" + string(argv[1]) + ".ch8";
+    // "-" reads the rom from standard input, a path is used as it is, anything else names a
+    // rom of the roms folder without its extension
+    std::string rom_path = argv[arg];
+    if (rom_path != "-" && !ifstream(rom_path))
+        rom_path = "./roms/" + rom_path + ".ch8";
     if (!chip8.load_rom(rom_path))
         return 1;
 
-    chip8.emulate();
+    // settings of the ROM from the index of its directory, which the frontend keeps for
+    // switching ROMs; a ROM from standard input switches within the roms folder
+    RomLibrary library;
+    {
+        filesystem::path path(rom_path == "-" ? "./roms/-" : rom_path);
+        AsyncRomLoader loader; // rescans read all new files at once
+        if (library.open(path.has_parent_path() ? path.parent_path().string() : ".", loader.reader()) && rom_path != "-")
+            if (const RomLibrary::Entry* entry = library.find(path.filename().string(), loader.reader()))
+                entry->settings.apply(chip8);
+    }
+
+    chip8.emulate(rom_path, library, run_ahead);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,64 @@
+#include "metrics.h"
+
+#include <mutex>
+#include <vector>
+
+namespace {
+    struct Registry {
+        std::mutex mutex;
+        std::vector<ThreadMetrics*> live;
+        uint64_t exited[METRIC_COUNTERS] = {};
+    };
+
+    // never destroyed, threads may exit after exit handlers ran
+    Registry& registry() {
+        static Registry* r = new Registry;
+        return *r;
+    }
+
+    // trivially constructed and destroyed, so it can be counted into until the thread is gone;
+    // counts after the registration below was destroyed are lost
+    thread_local ThreadMetrics counters;
+
+    struct Registration {
+        Registration() {
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            r.live.push_back(&counters);
+        }
+
+        ~Registration() {
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            for (int c = 0; c < METRIC_COUNTERS; c++)
+                r.exited[c] += counters.values[c].load(std::memory_order_relaxed);
+            for (size_t i = 0; i < r.live.size(); i++)
+                if (r.live[i] == &counters) {
+                    r.live[i] = r.live.back();
+                    r.live.pop_back();
+                    break;
+                }
+        }
+    };
+
+    void register_thread() {
+        thread_local Registration registration; // constructed here, destroyed when the thread exits
+        counters.registered = true;
+    }
+}
+
+ThreadMetrics& thread_metrics() {
+    if (!counters.registered)
+        register_thread();
+    return counters;
+}
+
+uint64_t metric_total(MetricCounter counter) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+
+    uint64_t total = r.exited[counter];
+    for (ThreadMetrics* thread : r.live)
+        total += thread->values[counter].load(std::memory_order_relaxed);
+    return total;
+}
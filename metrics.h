@@ -0,0 +1,50 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstdint>
+
+// Counters of the work done by every machine and the frontend. Each thread counts into its
+// own block, so counting takes no lock and no atomic read-modify-write; totals add up the
+// blocks of all threads, and of exited threads up to their exit.
+enum MetricCounter {
+    METRIC_INSTRUCTIONS, // executed by all machines, but not in a MetricsSuspension
+    METRIC_FRAMES, // emulated by all machines
+    METRIC_PRESENTED, // frames shown by the frontend
+    METRIC_DRAWS, // DXYN executed
+    METRIC_COLLISIONS, // DXYN that turned a pixel off
+    METRIC_DROPPED, // frame periods the frontend missed
+    METRIC_COUNTERS
+};
+
+// counters of one thread, only that thread adds to them
+struct ThreadMetrics {
+    std::atomic<uint64_t> values[METRIC_COUNTERS];
+    bool registered;
+    unsigned suspended; // MetricsSuspension scopes the thread is in
+
+    void add(MetricCounter counter, uint64_t n) {
+        if (suspended == 0)
+            values[counter].store(values[counter].load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+};
+
+ThreadMetrics& thread_metrics(); // of the calling thread, take it once to count several things
+inline void count_metric(MetricCounter counter, uint64_t n = 1) { thread_metrics().add(counter, n); }
+uint64_t metric_total(MetricCounter counter); // all threads
+
+// nothing the thread does is counted while one exists, for shadow machines such as run-ahead
+// snapshots that repeat work another machine already counted
+class MetricsSuspension {
+public:
+    MetricsSuspension() : metrics(thread_metrics()) { metrics.suspended++; }
+    ~MetricsSuspension() { metrics.suspended--; }
+
+    MetricsSuspension(const MetricsSuspension&) = delete;
+    MetricsSuspension& operator=(const MetricsSuspension&) = delete;
+
+private:
+    ThreadMetrics& metrics;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#include "pacer.h"
+#include "metrics.h"
+
+#include <cstdio>
+
+namespace {
+    const Uint64 FIRST_MARGIN = 2 * SDL_NS_PER_MS; // until the first sleeps have been measured
+    const Uint64 MIN_MARGIN = 200 * SDL_NS_PER_US;
+    const Uint64 SPIN_SLACK = 100 * SDL_NS_PER_US; // on top of the oversleep seen
+}
+
+FramePacer::FramePacer(unsigned frames_per_second)
+    : rate(frames_per_second > 0 ? frames_per_second : 60), margin(FIRST_MARGIN), previous(0) {
+    restart();
+}
+
+void FramePacer::restart() {
+    start = SDL_GetTicksNS();
+    frame = 0;
+}
+
+void FramePacer::wait() {
+    Uint64 target = deadline(++frame);
+    Uint64 now = SDL_GetTicksNS();
+
+    if (now + margin < target) {
+        Uint64 asked = target - now - margin;
+        SDL_DelayNS(asked);
+        Uint64 woke = SDL_GetTicksNS();
+
+        // the margin jumps up to a longer oversleep and comes down slowly after one
+        Uint64 over = woke - now > asked ? woke - now - asked : 0;
+        Uint64 decayed = margin - margin / 64;
+        margin = over + SPIN_SLACK > decayed ? over + SPIN_SLACK : decayed;
+        if (margin < MIN_MARGIN)
+            margin = MIN_MARGIN;
+
+        Uint64 period = SDL_NS_PER_SECOND / rate;
+        if (margin > period)
+            margin = period;
+
+        now = woke;
+    }
+
+    while (now < target) {
+        SDL_CPUPauseInstruction();
+        now = SDL_GetTicksNS();
+    }
+
+    // more than a frame behind, catching up would run the missed frames without a pause
+    if (now - target > SDL_NS_PER_SECOND / rate) {
+        count_metric(METRIC_DROPPED, (now - target) / (SDL_NS_PER_SECOND / rate));
+        late++;
+        start = now;
+        frame = 0;
+    }
+
+    if (previous != 0)
+        times.add(now - previous);
+    previous = now;
+}
+
+void FramePacer::log_summary() const {
+    if (times.count() == 0)
+        return;
+
+    SDL_Log("Frame times over %llu frames: p50 %.3f ms, p99 %.3f ms, max %.3f ms, %llu late",
+            (unsigned long long)times.count(), times.percentile(50) / 1e6, times.percentile(99) / 1e6,
+            times.max() / 1e6, (unsigned long long)late);
+}
+
+bool FramePacer::write_histogram(const std::string& path) const {
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == NULL)
+        return false;
+
+    times.write(file);
+    return fclose(file) == 0;
+}
@@ -0,0 +1,42 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include "histogram.h"
+
+#include <string>
+
+#include <SDL3/SDL.h>
+
+// Paces the main loop at an exact frame rate. Deadlines are whole multiples of the frame
+// period from a start time, so there is no drift from rounding 1/60 s. Waiting sleeps until
+// shortly before the deadline and spins through the rest, the sleep margin following how much
+// the scheduler has recently overslept. When the loop falls behind by more than a frame (a ROM
+// switch, a dragged window) the schedule restarts instead of running frames back to back.
+class FramePacer {
+public:
+    explicit FramePacer(unsigned frames_per_second = 60);
+
+    void wait(); // returns at the next frame deadline
+    void restart(); // the next frame is a period from now
+
+    // frame times, from one return of wait() to the next
+    const TimeHistogram& frame_times() const { return times; }
+    Uint64 late_frames() const { return late; }
+
+    void log_summary() const; // p50, p99 and max with SDL_Log
+    bool write_histogram(const std::string& path) const; // the frame times, see TimeHistogram::write
+
+private:
+    unsigned rate;
+    Uint64 start;
+    Uint64 frame;
+    Uint64 margin; // ns before the deadline the sleep ends and the spin begins
+    Uint64 previous; // return of the last wait(), 0 before the first
+
+    TimeHistogram times;
+    Uint64 late = 0;
+
+    Uint64 deadline(Uint64 n) const { return start + n * SDL_NS_PER_SECOND / rate; }
+};
+
+#endif
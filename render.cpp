@@ -0,0 +1,225 @@
+#include "render.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RENDER_X86
+#endif
+
+namespace {
+    typedef void (*ExpandPixels)(const uint64_t* rows, void* pixels, int pitch, uint32_t on, uint32_t off);
+    typedef void (*ExpandBytes)(const uint64_t* rows, uint8_t* out);
+
+    void expand_pixels_scalar(const uint64_t* rows, void* pixels, int pitch, uint32_t on, uint32_t off) {
+        uint8_t* line = (uint8_t*)pixels;
+        uint32_t diff = on ^ off;
+
+        for (int y = 0; y < 32; y++) {
+            uint32_t* out = (uint32_t*)line;
+            uint64_t row = rows[y];
+
+            // leftmost pixel is the top bit, select the color without branching
+            for (int x = 0; x < 64; x++)
+                out[x] = off ^ (diff & (0 - (uint32_t)((row >> (63 - x)) & 1)));
+
+            line += pitch;
+        }
+    }
+
+    void expand_bytes_scalar(const uint64_t* rows, uint8_t* out) {
+        for (int y = 0; y < 32; y++) {
+            uint64_t row = rows[y];
+            for (int x = 0; x < 64; x++)
+                out[x] = (uint8_t)(0 - ((row >> (63 - x)) & 1));
+            out += 64;
+        }
+    }
+
+#ifdef RENDER_X86
+    // row with its leftmost pixel in bit 0, so vector lane i takes bit i
+    inline uint64_t reverse_bits(uint64_t row) {
+        row = ((row >> 1) & 0x5555555555555555ull) | ((row & 0x5555555555555555ull) << 1);
+        row = ((row >> 2) & 0x3333333333333333ull) | ((row & 0x3333333333333333ull) << 2);
+        row = ((row >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((row & 0x0F0F0F0F0F0F0F0Full) << 4);
+        return __builtin_bswap64(row);
+    }
+
+    // 4 pixels a vector, each lane tests its bit of a nibble
+    __attribute__((target("sse2")))
+    void expand_pixels_sse2(const uint64_t* rows, void* pixels, int pitch, uint32_t on, uint32_t off) {
+        const __m128i bits = _mm_set_epi32(8, 4, 2, 1);
+        const __m128i diff = _mm_set1_epi32((int)(on ^ off));
+        const __m128i dark = _mm_set1_epi32((int)off);
+
+        uint8_t* line = (uint8_t*)pixels;
+        for (int y = 0; y < 32; y++) {
+            uint64_t row = reverse_bits(rows[y]);
+            for (int x = 0; x < 16; x++) {
+                __m128i nibble = _mm_set1_epi32((int)(row >> (x * 4)) & 0xF);
+                __m128i lit = _mm_cmpeq_epi32(_mm_and_si128(nibble, bits), bits);
+                _mm_storeu_si128((__m128i*)line + x, _mm_xor_si128(dark, _mm_and_si128(diff, lit)));
+            }
+            line += pitch;
+        }
+    }
+
+    // 16 pixels a vector, the two bytes of the pixels are spread over 8 lanes each
+    __attribute__((target("sse2")))
+    void expand_bytes_sse2(const uint64_t* rows, uint8_t* out) {
+        const __m128i bits = _mm_set_epi8((char)128, 64, 32, 16, 8, 4, 2, 1, (char)128, 64, 32, 16, 8, 4, 2, 1);
+
+        for (int y = 0; y < 32; y++) {
+            uint64_t row = reverse_bits(rows[y]);
+            for (int x = 0; x < 4; x++) {
+                __m128i spread = _mm_cvtsi32_si128((int)(row >> (x * 16)) & 0xFFFF);
+                spread = _mm_unpacklo_epi8(spread, spread);
+                spread = _mm_unpacklo_epi16(spread, spread);
+                spread = _mm_unpacklo_epi32(spread, spread);
+                _mm_storeu_si128((__m128i*)out + x, _mm_cmpeq_epi8(_mm_and_si128(spread, bits), bits));
+            }
+            out += 64;
+        }
+    }
+
+    // 8 pixels a vector, each lane tests its bit of a byte
+    __attribute__((target("avx2")))
+    void expand_pixels_avx2(const uint64_t* rows, void* pixels, int pitch, uint32_t on, uint32_t off) {
+        const __m256i bits = _mm256_set_epi32(128, 64, 32, 16, 8, 4, 2, 1);
+        const __m256i diff = _mm256_set1_epi32((int)(on ^ off));
+        const __m256i dark = _mm256_set1_epi32((int)off);
+
+        uint8_t* line = (uint8_t*)pixels;
+        for (int y = 0; y < 32; y++) {
+            uint64_t row = reverse_bits(rows[y]);
+            for (int x = 0; x < 8; x++) {
+                __m256i byte = _mm256_set1_epi32((int)(row >> (x * 8)) & 0xFF);
+                __m256i lit = _mm256_cmpeq_epi32(_mm256_and_si256(byte, bits), bits);
+                _mm256_storeu_si256((__m256i*)line + x, _mm256_xor_si256(dark, _mm256_and_si256(diff, lit)));
+            }
+            line += pitch;
+        }
+    }
+
+    // 32 pixels a vector, a shuffle copies byte i / 8 of the pixels into lane i
+    __attribute__((target("avx2")))
+    void expand_bytes_avx2(const uint64_t* rows, uint8_t* out) {
+        const __m256i spread_bytes = _mm256_set_epi8(3, 3, 3, 3, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 2,
+                                                     1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m256i bits = _mm256_set1_epi64x((long long)0x8040201008040201ull);
+
+        for (int y = 0; y < 32; y++) {
+            uint64_t row = reverse_bits(rows[y]);
+            for (int x = 0; x < 2; x++) {
+                // both 128-bit halves hold the same four bytes, as the shuffle stays within a half
+                __m256i spread = _mm256_set1_epi32((int)(uint32_t)(row >> (x * 32)));
+                spread = _mm256_shuffle_epi8(spread, spread_bytes);
+                _mm256_storeu_si256((__m256i*)out + x, _mm256_cmpeq_epi8(_mm256_and_si256(spread, bits), bits));
+            }
+            out += 64;
+        }
+    }
+
+    // 16 pixels a vector, the bits of the row are the blend mask
+    __attribute__((target("avx512f")))
+    void expand_pixels_avx512(const uint64_t* rows, void* pixels, int pitch, uint32_t on, uint32_t off) {
+        const __m512i lit = _mm512_set1_epi32((int)on);
+        const __m512i dark = _mm512_set1_epi32((int)off);
+
+        uint8_t* line = (uint8_t*)pixels;
+        for (int y = 0; y < 32; y++) {
+            uint64_t row = reverse_bits(rows[y]);
+            for (int x = 0; x < 4; x++)
+                _mm512_storeu_si512((__m512i*)line + x, _mm512_mask_blend_epi32((__mmask16)(row >> (x * 16)), dark, lit));
+            line += pitch;
+        }
+    }
+
+    // a whole row a vector, straight from the mask
+    __attribute__((target("avx512f,avx512bw")))
+    void expand_bytes_avx512(const uint64_t* rows, uint8_t* out) {
+        for (int y = 0; y < 32; y++)
+            _mm512_storeu_si512((__m512i*)(out + y * 64), _mm512_movm_epi8((__mmask64)reverse_bits(rows[y])));
+    }
+#endif
+
+    struct Kernels {
+        ExpandPixels pixels;
+        ExpandBytes bytes;
+    };
+
+    // by SimdLevel, only scalar on other architectures
+    const Kernels kernels[] = {
+        { expand_pixels_scalar, expand_bytes_scalar },
+#ifdef RENDER_X86
+        { expand_pixels_sse2, expand_bytes_sse2 },
+        { expand_pixels_avx2, expand_bytes_avx2 },
+        { expand_pixels_avx512, expand_bytes_avx512 },
+#endif
+    };
+    const int LEVELS = sizeof(kernels) / sizeof(kernels[0]);
+
+    const char* const level_names[] = { "scalar", "sse2", "avx2", "avx512" };
+
+    SimdLevel best_level() {
+        SimdLevel level = SIMD_SCALAR;
+        for (int l = SIMD_SSE2; l <= SIMD_AVX512; l++)
+            if (simd_supported((SimdLevel)l))
+                level = (SimdLevel)l;
+
+        const char* cap = getenv("CHIP8_SIMD");
+        for (int l = 0; cap && l < level; l++)
+            if (strcmp(cap, level_names[l]) == 0)
+                level = (SimdLevel)l;
+
+        return level;
+    }
+
+    SimdLevel& active_level() {
+        static SimdLevel level = best_level();
+        return level;
+    }
+}
+
+bool simd_supported(SimdLevel level) {
+    if (level == SIMD_SCALAR)
+        return true;
+    if (level >= LEVELS)
+        return false;
+
+#ifdef RENDER_X86
+    __builtin_cpu_init();
+    switch (level) {
+        case SIMD_SSE2: return __builtin_cpu_supports("sse2");
+        case SIMD_AVX2: return __builtin_cpu_supports("avx2");
+        case SIMD_AVX512: return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+        default: break;
+    }
+#endif
+    return false;
+}
+
+SimdLevel simd_level() {
+    return active_level();
+}
+
+bool set_simd_level(SimdLevel level) {
+    if (!simd_supported(level))
+        return false;
+
+    active_level() = level;
+    return true;
+}
+
+const char* simd_level_name(SimdLevel level) {
+    return level_names[level];
+}
+
+void expand_framebuffer(const uint64_t* rows, void* pixels, int pitch, uint32_t on, uint32_t off) {
+    kernels[active_level()].pixels(rows, pixels, pitch, on, off);
+}
+
+void expand_framebuffer_bytes(const uint64_t* rows, uint8_t* out) {
+    kernels[active_level()].bytes(rows, out);
+}
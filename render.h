@@ -0,0 +1,21 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <cstdint>
+
+// Instruction sets the kernels are compiled for. The best one the CPU supports is picked on
+// first use; CHIP8_SIMD=scalar, sse2, avx2 or avx512 in the environment caps the choice.
+enum SimdLevel { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2, SIMD_AVX512 };
+
+SimdLevel simd_level(); // level the kernels run at
+bool simd_supported(SimdLevel level); // whether this CPU can run the level
+bool set_simd_level(SimdLevel level); // false when the CPU lacks it; not while kernels run on other threads
+const char* simd_level_name(SimdLevel level);
+
+// expands 32 packed display rows into 64x32 32-bit pixels, pitch is the row length in bytes
+void expand_framebuffer(const uint64_t* rows, void* pixels, int pitch, uint32_t on, uint32_t off);
+
+// expands 32 packed display rows into 64x32 bytes, 255 for a lit pixel and 0 for a dark one
+void expand_framebuffer_bytes(const uint64_t* rows, uint8_t* out);
+
+#endif
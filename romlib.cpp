@@ -0,0 +1,440 @@
+#include "romlib.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+    struct KnownRom {
+        uint8_t hash[20];
+        const char* title;
+        uint16_t cycles_per_frame;
+        uint8_t quirks;
+    };
+
+    // sorted by hash
+    const KnownRom known_roms[] = {
+        { { 0x1b, 0xa5, 0x86, 0x56, 0x81, 0x0b, 0x67, 0xfd, 0x13, 0x1e, 0xb9, 0xaf, 0x3e, 0x39, 0x87, 0x86, 0x3b, 0xf2, 0x6c, 0x90 },
+          "IBM Logo", Chip8::CYCLES_PER_FRAME, 0 },
+        { { 0x23, 0x77, 0x56, 0xa4, 0x01, 0x4f, 0xb3, 0xaa, 0x82, 0xa2, 0x92, 0x46, 0xa7, 0xcd, 0xd5, 0x34, 0xf8, 0xdc, 0x2d, 0xbb },
+          "Breakout (Carmelo Cortez, 1979)", Chip8::CYCLES_PER_FRAME, 0 },
+        { { 0x50, 0x7e, 0x7d, 0xc6, 0x78, 0x35, 0x65, 0x07, 0x1d, 0xfe, 0x4b, 0x72, 0x15, 0x4a, 0xf4, 0x31, 0xd4, 0x46, 0x69, 0x58 },
+          "Particle Demo (zeroZshadow, 2008)", Chip8::CYCLES_PER_FRAME, 0 },
+        { { 0x5f, 0x51, 0x80, 0x84, 0x74, 0x4b, 0xf3, 0xcb, 0x87, 0x33, 0xf6, 0xe5, 0x45, 0x4d, 0xfd, 0x16, 0x34, 0x32, 0x05, 0x63 },
+          "Tetris (Fran Dachille, 1991)", Chip8::CYCLES_PER_FRAME, 0 },
+        { { 0x60, 0x7c, 0x4f, 0x7f, 0x4e, 0x4d, 0xce, 0x9f, 0x99, 0xd9, 0x6b, 0x31, 0x82, 0xbf, 0xe7, 0xe8, 0x8b, 0xb0, 0x90, 0xee },
+          "Pong 1 player (Paul Vervalin, 1990)", Chip8::CYCLES_PER_FRAME, 0 },
+        { { 0x8b, 0x70, 0x08, 0x0a, 0xdb, 0xac, 0x44, 0x51, 0x3e, 0xc6, 0x00, 0x05, 0x73, 0x4a, 0x81, 0x63, 0x72, 0xb8, 0x45, 0xec },
+          "Maze (David Winter, 199x)", Chip8::CYCLES_PER_FRAME, 0 },
+        { { 0xb2, 0x32, 0xef, 0x88, 0x0b, 0xd6, 0x06, 0x0f, 0xb4, 0x5f, 0xa6, 0xef, 0xfe, 0xd7, 0xed, 0xf0, 0xae, 0x95, 0x67, 0x0e },
+          "Pong (Paul Vervalin, 1990)", Chip8::CYCLES_PER_FRAME, 0 },
+        // kills are bit masks built with 8XYE on the register itself
+        { { 0xf1, 0x00, 0x19, 0x7f, 0x0f, 0x2f, 0x05, 0xb4, 0xf3, 0xc8, 0xc3, 0x1a, 0xb9, 0xc2, 0xc3, 0x93, 0x0d, 0x3e, 0x95, 0x71 },
+          "Space Invaders (David Winter)", Chip8::CYCLES_PER_FRAME, Chip8::QUIRK_SHIFT },
+    };
+
+    // header of the index file, followed by the entries and then their names
+    struct IndexHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t count;
+        int64_t modified; // directory time when the index was written
+    };
+
+    const char INDEX_MAGIC[8] = { 'C', 'H', 'I', 'P', '8', 'I', 'D', 'X' };
+    const uint32_t INDEX_VERSION = 1;
+
+    // the index is mapped as it is on disk, so its layout must not depend on the compiler
+    static_assert(sizeof(IndexHeader) == 24, "index header without padding");
+    static_assert(sizeof(RomSettings) == 4 && offsetof(RomSettings, quirks) == 2, "settings without padding");
+    static_assert(offsetof(RomLibrary::Entry, hash) == 8 && offsetof(RomLibrary::Entry, size) == 28 &&
+                  offsetof(RomLibrary::Entry, name_offset) == 32 && offsetof(RomLibrary::Entry, name_length) == 36 &&
+                  offsetof(RomLibrary::Entry, settings) == 38 && offsetof(RomLibrary::Entry, known) == 42 &&
+                  offsetof(RomLibrary::Entry, reserved) == 43 && sizeof(RomLibrary::Entry) == 48, "index entry without padding");
+
+    uint32_t rotl(uint32_t x, int n) {
+        return (x << n) | (x >> (32 - n));
+    }
+
+    void sha1_block(uint32_t* h, const uint8_t* block) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++)
+            w[i] = (uint32_t)block[i * 4] << 24 | block[i * 4 + 1] << 16 | block[i * 4 + 2] << 8 | block[i * 4 + 3];
+        for (int i = 16; i < 80; i++)
+            w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+
+            uint32_t t = rotl(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotl(b, 30);
+            b = a;
+            a = t;
+        }
+
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+
+    int64_t file_time(const fs::path& path, std::error_code& error) {
+        return (int64_t)fs::last_write_time(path, error).time_since_epoch().count();
+    }
+
+    bool is_rom_file(const fs::directory_entry& file) {
+        std::string extension = file.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        return file.is_regular_file() && (extension == ".ch8" || extension == ".c8");
+    }
+}
+
+void RomSettings::apply(Chip8& chip8) const {
+    chip8.set_cycles_per_frame(cycles_per_frame);
+    chip8.set_quirks(quirks);
+}
+
+RomHash RomHash::of(const uint8_t* data, size_t size) {
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+    size_t whole = size / 64 * 64;
+    for (size_t i = 0; i < whole; i += 64)
+        sha1_block(h, data + i);
+
+    // rest of the data, a single 1 bit, zeros and the length in bits in the last 8 bytes
+    uint8_t tail[128] = {};
+    size_t rest = size - whole;
+    memcpy(tail, data + whole, rest);
+    tail[rest] = 0x80;
+    size_t tail_size = rest + 9 <= 64 ? 64 : 128;
+    for (int i = 0; i < 8; i++)
+        tail[tail_size - 1 - i] = (uint8_t)((uint64_t)size * 8 >> (i * 8));
+
+    for (size_t i = 0; i < tail_size; i += 64)
+        sha1_block(h, tail + i);
+
+    RomHash hash;
+    for (int i = 0; i < 20; i++)
+        hash.bytes[i] = (uint8_t)(h[i / 4] >> (24 - i % 4 * 8));
+    return hash;
+}
+
+std::string RomHash::hex() const {
+    static const char digits[] = "0123456789abcdef";
+
+    std::string text;
+    for (uint8_t byte : bytes) {
+        text += digits[byte >> 4];
+        text += digits[byte & 0xF];
+    }
+    return text;
+}
+
+RomSettings default_rom_settings() {
+    return RomSettings { Chip8::CYCLES_PER_FRAME, 0, 0 };
+}
+
+bool find_known_rom(const RomHash& hash, RomSettings& settings, const char** title) {
+    const KnownRom* end = known_roms + sizeof(known_roms) / sizeof(known_roms[0]);
+    const KnownRom* rom = std::lower_bound(known_roms, end, hash, [](const KnownRom& known, const RomHash& wanted) {
+        return memcmp(known.hash, wanted.bytes, 20) < 0;
+    });
+
+    settings = default_rom_settings();
+    if (rom == end || memcmp(rom->hash, hash.bytes, 20) != 0)
+        return false;
+
+    settings.cycles_per_frame = rom->cycles_per_frame;
+    settings.quirks = rom->quirks;
+    if (title)
+        *title = rom->title;
+    return true;
+}
+
+void read_roms(const std::vector<std::string>& paths, const RomReceiver& receive) {
+    std::vector<uint8_t> bytes(Chip8::MAX_ROM_SIZE); // never empty, so even an empty file gets a pointer
+    for (size_t i = 0; i < paths.size(); i++) {
+        std::ifstream rom(paths[i], std::ios_base::binary | std::ios_base::ate);
+        std::streamoff size = rom ? (std::streamoff)rom.tellg() : -1;
+        if (size < 0 || size > Chip8::MAX_ROM_SIZE) {
+            receive(i, nullptr, 0);
+            continue;
+        }
+
+        rom.seekg(0);
+        bool read = (bool)rom.read((char*)bytes.data(), size);
+        receive(i, read ? bytes.data() : nullptr, read ? (size_t)size : 0);
+    }
+}
+
+const char* const RomLibrary::INDEX_NAME = ".chip8index";
+
+bool RomLibrary::open(const std::string& dir, const RomReader& reader) {
+    close();
+    directory = dir;
+
+    std::error_code error;
+    int64_t modified = file_time(dir, error);
+    if (error)
+        return false;
+
+    if (map((fs::path(dir) / INDEX_NAME).string())) {
+        const IndexHeader* header = (const IndexHeader*)mapping;
+        if (header->modified == modified)
+            return true;
+        close();
+    }
+
+    return scan(dir, reader);
+}
+
+bool RomLibrary::scan(const std::string& dir, const RomReader& reader) {
+    // hashes of the current index are reused for files whose size and time did not change
+    std::vector<Entry> old_entries;
+    std::vector<std::string> old_names;
+    if (mapping == nullptr || directory != dir) {
+        close();
+        map((fs::path(dir) / INDEX_NAME).string());
+    }
+    for (size_t i = 0; i < count; i++) {
+        old_entries.push_back(entries[i]);
+        old_names.push_back(name(entries[i]));
+    }
+    close();
+    directory = dir;
+
+    std::vector<std::pair<std::string, Entry>> found;
+    std::vector<std::string> unread; // new or changed files, hashed after the walk
+    std::vector<size_t> unread_entries; // their places in found
+    std::error_code error;
+    for (const fs::directory_entry& file : fs::directory_iterator(dir, error)) {
+        if (!is_rom_file(file))
+            continue;
+
+        Entry entry;
+        memset(&entry, 0, sizeof(entry));
+        std::string file_name = file.path().filename().string();
+        entry.size = (uint32_t)file.file_size(error);
+        entry.modified = file_time(file.path(), error);
+        if (error || entry.size > Chip8::MAX_ROM_SIZE || file_name.size() > 0xFFFF)
+            continue;
+
+        // old names are sorted like the index
+        auto old = std::lower_bound(old_names.begin(), old_names.end(), file_name);
+        const Entry* same = old == old_names.end() || *old != file_name ? nullptr : &old_entries[old - old_names.begin()];
+        if (same && same->size == entry.size && same->modified == entry.modified) {
+            entry.hash = same->hash;
+        } else {
+            unread.push_back(file.path().string());
+            unread_entries.push_back(found.size());
+        }
+
+        found.emplace_back(file_name, entry);
+    }
+    if (error)
+        return false;
+
+    // all files to hash are handed to the reader at once, it may read them in any order;
+    // files which cannot be read or changed size meanwhile are left out
+    std::vector<bool> missing(found.size());
+    for (size_t i : unread_entries)
+        missing[i] = true;
+
+    auto receive = [&](size_t i, const uint8_t* data, size_t size) {
+        Entry& entry = found[unread_entries[i]].second;
+        if (data == nullptr || size != entry.size)
+            return;
+
+        entry.hash = RomHash::of(data, size);
+        missing[unread_entries[i]] = false;
+    };
+    if (reader)
+        reader(unread, receive);
+    else
+        read_roms(unread, receive);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < found.size(); i++) {
+        if (missing[i])
+            continue;
+
+        RomSettings settings;
+        found[i].second.known = find_known_rom(found[i].second.hash, settings);
+        found[i].second.settings = settings;
+        if (kept != i)
+            found[kept] = std::move(found[i]);
+        kept++;
+    }
+    found.resize(kept);
+
+    std::sort(found.begin(), found.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    IndexHeader header;
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version = INDEX_VERSION;
+    header.count = (uint32_t)found.size();
+    header.modified = 0; // known once the file is in place
+
+    std::string text;
+    for (auto& [file_name, entry] : found) {
+        entry.name_offset = (uint32_t)text.size();
+        entry.name_length = (uint16_t)file_name.size();
+        text += file_name;
+    }
+
+    // written beside the index and renamed over it, readers never see half an index
+    fs::path path = fs::path(dir) / INDEX_NAME;
+    fs::path temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream out(temporary, std::ios_base::binary | std::ios_base::trunc);
+        out.write((const char*)&header, sizeof(header));
+        for (const auto& found_entry : found)
+            out.write((const char*)&found_entry.second, sizeof(Entry));
+        out.write(text.data(), text.size());
+        if (!out)
+            return false;
+    }
+    fs::rename(temporary, path, error);
+    if (error)
+        return false;
+
+    // the directory time after the rename, which itself changed it
+    header.modified = file_time(dir, error);
+    {
+        std::fstream out(path, std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+        out.write((const char*)&header, sizeof(header));
+        if (!out)
+            return false;
+    }
+
+    return map(path.string());
+}
+
+const RomLibrary::Entry* RomLibrary::find(const std::string& file, const RomReader& reader) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        const Entry* end = entries + count;
+        const Entry* entry = std::lower_bound(entries, end, file, [this](const Entry& e, const std::string& wanted) {
+            return name(e) < wanted;
+        });
+
+        std::error_code error;
+        fs::path path = fs::path(directory) / file;
+        if (entry != end && name(*entry) == file && entry->size == fs::file_size(path, error) &&
+            entry->modified == file_time(path, error) && !error)
+            return entry;
+
+        // missing or changed since the index was written
+        if (attempt > 0 || !fs::exists(path, error) || !scan(directory, reader))
+            return nullptr;
+    }
+
+    return nullptr;
+}
+
+bool RomLibrary::map(const std::string& path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    HANDLE handle = GetFileSizeEx(file, &size) && size.QuadPart > 0 ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    CloseHandle(file);
+    if (handle == NULL)
+        return false;
+
+    const void* view = MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0);
+    if (view == NULL) {
+        CloseHandle(handle);
+        return false;
+    }
+
+    mapping_handle = handle;
+    mapping_size = (size_t)size.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    void* view = fstat(fd, &info) == 0 && info.st_size > 0 ? mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (view == MAP_FAILED)
+        return false;
+
+    mapping_size = (size_t)info.st_size;
+#endif
+    mapping = (const uint8_t*)view;
+
+    // an index of another version or a damaged one is as good as none
+    const IndexHeader* header = (const IndexHeader*)mapping;
+    if (mapping_size < sizeof(IndexHeader) || memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+        header->version != INDEX_VERSION || (mapping_size - sizeof(IndexHeader)) / sizeof(Entry) < header->count) {
+        close();
+        return false;
+    }
+
+    count = header->count;
+    entries = (const Entry*)(mapping + sizeof(IndexHeader));
+    names = (const char*)(entries + count);
+
+    size_t names_size = mapping_size - sizeof(IndexHeader) - count * sizeof(Entry);
+    for (size_t i = 0; i < count; i++)
+        if ((size_t)entries[i].name_offset + entries[i].name_length > names_size) {
+            close();
+            return false;
+        }
+
+    return true;
+}
+
+void RomLibrary::close() {
+    if (mapping) {
+#ifdef _WIN32
+        UnmapViewOfFile(mapping);
+        CloseHandle(mapping_handle);
+        mapping_handle = nullptr;
+#else
+        munmap((void*)mapping, mapping_size);
+#endif
+    }
+
+    mapping = nullptr;
+    mapping_size = 0;
+    entries = nullptr;
+    names = nullptr;
+    count = 0;
+}
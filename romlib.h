@@ -0,0 +1,97 @@
+#ifndef ROMLIB_H
+#define ROMLIB_H
+
+#include "chip8.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// how a ROM wants to be run
+struct RomSettings {
+    uint16_t cycles_per_frame;
+    uint8_t quirks; // Chip8::QUIRK_ bits
+    uint8_t reserved; // 0, fills the settings so index entries have no padding
+
+    void apply(Chip8& chip8) const;
+};
+
+// SHA-1 of a ROM, the key of the known ROM database
+struct RomHash {
+    uint8_t bytes[20];
+
+    static RomHash of(const uint8_t* data, size_t size);
+    std::string hex() const;
+};
+
+// title and settings of a ROM in the built in database of known ROMs, false leaves settings
+// at their defaults for ROMs it does not know
+bool find_known_rom(const RomHash& hash, RomSettings& settings, const char** title = nullptr);
+RomSettings default_rom_settings();
+
+// Reading many ROM files at once. A reader calls the receiver once per path, with its index
+// in paths, on the thread that called the reader and in any order, with null data when the
+// file cannot be read or is larger than a ROM can be. The data is only valid during the call.
+typedef std::function<void(size_t index, const uint8_t* data, size_t size)> RomReceiver;
+typedef std::function<void(const std::vector<std::string>& paths, const RomReceiver& receive)> RomReader;
+
+void read_roms(const std::vector<std::string>& paths, const RomReceiver& receive); // one file after another
+
+// Index of a ROM directory: name, size, modification time, hash and settings of every file,
+// sorted by name. It is kept in the directory as a binary file which is memory-mapped when
+// opened, so looking up a ROM reads no ROM and parses nothing. A scan rehashes only files
+// whose size or time changed since the index was written.
+class RomLibrary {
+public:
+    static const char* const INDEX_NAME; // file of the index inside the directory
+
+    // the index file is an array of these, every byte of them is a field so nothing
+    // uninitialized reaches the file; the layout is checked in romlib.cpp
+    struct Entry {
+        int64_t modified; // file time, in the clock units of std::filesystem
+        RomHash hash;
+        uint32_t size;
+        uint32_t name_offset; // into the names after the entries, not terminated
+        uint16_t name_length;
+        RomSettings settings;
+        uint8_t known; // settings come from the database
+        uint8_t reserved[5]; // 0
+    };
+
+    RomLibrary() = default;
+    RomLibrary(const RomLibrary&) = delete;
+    RomLibrary& operator=(const RomLibrary&) = delete;
+    ~RomLibrary() { close(); }
+
+    // Scans read the files to hash with read_roms(), or with the given reader.
+
+    // maps the index of dir, scanning first when there is none or files were added or removed
+    bool open(const std::string& dir, const RomReader& reader = nullptr);
+    bool scan(const std::string& dir, const RomReader& reader = nullptr); // walks dir and writes its index, then maps it
+    void close();
+
+    // entry of a file of the directory, rescans when the file changed since the index was written
+    const Entry* find(const std::string& file, const RomReader& reader = nullptr);
+
+    size_t size() const { return count; }
+    const Entry& operator[](size_t i) const { return entries[i]; }
+    std::string name(const Entry& entry) const { return std::string(names + entry.name_offset, entry.name_length); }
+
+private:
+    std::string directory;
+
+    const uint8_t* mapping = nullptr;
+    size_t mapping_size = 0;
+#ifdef _WIN32
+    void* mapping_handle = nullptr;
+#endif
+
+    const Entry* entries = nullptr;
+    const char* names = nullptr;
+    size_t count = 0;
+
+    bool map(const std::string& path);
+};
+
+#endif
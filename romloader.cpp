@@ -0,0 +1,40 @@
+#include "romloader.h"
+
+AsyncRomLoader::AsyncRomLoader(unsigned max_in_flight) : max_in_flight(max_in_flight > 0 ? max_in_flight : 1) {
+    queue = SDL_CreateAsyncIOQueue();
+}
+
+AsyncRomLoader::~AsyncRomLoader() {
+    if (queue)
+        SDL_DestroyAsyncIOQueue(queue);
+}
+
+void AsyncRomLoader::read(const std::vector<std::string>& paths, const RomReceiver& receive) {
+    if (queue == NULL) {
+        read_roms(paths, receive);
+        return;
+    }
+
+    size_t next = 0; // first path not queued yet
+    size_t pending = 0;
+    while (next < paths.size() || pending > 0) {
+        while (next < paths.size() && pending < max_in_flight) {
+            // the index of the path travels as the user data of the read
+            if (SDL_LoadFileAsync(paths[next].c_str(), queue, (void*)(uintptr_t)next))
+                pending++;
+            else
+                receive(next, nullptr, 0);
+            next++;
+        }
+
+        SDL_AsyncIOOutcome outcome;
+        if (pending == 0 || !SDL_WaitAsyncIOResult(queue, &outcome, -1))
+            continue;
+        pending--;
+
+        bool ok = outcome.result == SDL_ASYNCIO_COMPLETE && outcome.bytes_transferred <= Chip8::MAX_ROM_SIZE;
+        receive((size_t)(uintptr_t)outcome.userdata, ok ? (const uint8_t*)outcome.buffer : nullptr,
+                ok ? (size_t)outcome.bytes_transferred : 0);
+        SDL_free(outcome.buffer);
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef ROMLOADER_H
+#define ROMLOADER_H
+
+#include "romlib.h"
+
+#include <SDL3/SDL.h>
+
+// Loads many ROM files at once with SDL's asynchronous I/O. Reads are queued up to a limit
+// and ROMs are handed to the receiver as they complete, so a large batch is bound by the
+// disk rather than by waiting for one open and read after another. read() fits RomReader.
+class AsyncRomLoader {
+public:
+    explicit AsyncRomLoader(unsigned max_in_flight = 256); // reads queued at the same time
+    ~AsyncRomLoader();
+
+    AsyncRomLoader(const AsyncRomLoader&) = delete;
+    AsyncRomLoader& operator=(const AsyncRomLoader&) = delete;
+
+    // calls receive for every path before returning, reads one file after another when SDL
+    // cannot queue the reads
+    void read(const std::vector<std::string>& paths, const RomReceiver& receive);
+
+    RomReader reader() { return [this](const std::vector<std::string>& paths, const RomReceiver& receive) { read(paths, receive); }; }
+
+private:
+    SDL_AsyncIOQueue* queue;
+    unsigned max_in_flight;
+};
+
+#endif
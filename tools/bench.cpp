@@ -0,0 +1,357 @@
+// Benchmarks of the emulator core, results are printed as JSON lines:
+// {"bench":"<name>","metric":"<unit>","value":<number>,"cpu":"<model>","compiler":"<version>"}
+// cpu and compiler fingerprint the host so results from different machines are never compared
+//
+// usage: chip8_bench [--roms-only] [rom directory]
+
+#include "../chip8.h"
+#include "../metrics.h"
+#include "../render.h"
+#include "../gamespec.h"
+#include "../vecenv.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static const int REPEATS = 5; // best of REPEATS runs is reported
+static const unsigned MICRO_INSTRUCTIONS = 2000000;
+static const unsigned RENDER_FRAMES = 200000;
+static const unsigned ROM_FRAMES = 60000; // about 17 minutes of emulated time
+static const unsigned FORKS = 200000;
+static const unsigned RUN_AHEAD = 2; // frames run past every frame by bench_run_ahead
+static const unsigned VECENV_SIZE = 64;
+static const unsigned VECENV_STEPS = 2000;
+
+static volatile uint64_t sink; // keeps results observable
+
+static string cpu_model;
+static const char* compiler =
+#if defined(__clang__)
+    "clang " __clang_version__;
+#elif defined(__GNUC__)
+    "gcc " __VERSION__;
+#else
+    "unknown";
+#endif
+
+// processor brand string, for example "Intel(R) Xeon(R) Processor"
+static string read_cpu_model() {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned regs[12];
+    if (__get_cpuid_max(0x80000000, NULL) >= 0x80000004) {
+        for (unsigned i = 0; i < 3; i++)
+            __get_cpuid(0x80000002 + i, &regs[i * 4], &regs[i * 4 + 1], &regs[i * 4 + 2], &regs[i * 4 + 3]);
+
+        string model((const char*)regs, sizeof(regs));
+        model = model.c_str(); // cut at the terminator
+        size_t first = model.find_first_not_of(' ');
+        size_t last = model.find_last_not_of(' ');
+        if (first != string::npos)
+            return model.substr(first, last - first + 1);
+    }
+#endif
+    return "unknown";
+}
+
+static double now_ns() {
+    return (double)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void report(const string& bench, const char* metric, double value) {
+    printf("{\"bench\":\"%s\",\"metric\":\"%s\",\"value\":%.4f,\"cpu\":\"%s\",\"compiler\":\"%s\"}\n",
+        bench.c_str(), metric, value, cpu_model.c_str(), compiler);
+    fprintf(stderr, "%-28s %14.3f %s\n", bench.c_str(), value, metric);
+}
+
+// a benchmark this host cannot run, so comparisons skip it rather than call it missing
+static void report_unsupported(const string& bench, const char* metric) {
+    printf("{\"bench\":\"%s\",\"metric\":\"%s\",\"unsupported\":true,\"cpu\":\"%s\",\"compiler\":\"%s\"}\n",
+        bench.c_str(), metric, cpu_model.c_str(), compiler);
+    fprintf(stderr, "%-28s %14s %s\n", bench.c_str(), "unsupported", metric);
+}
+
+static uint64_t checksum(const Chip8& chip8) {
+    uint64_t sum = 0;
+    for (int y = 0; y < 32; y++)
+        sum ^= chip8.framebuffer()[y] + y;
+    return sum;
+}
+
+static vector<uint8_t> assemble(const vector<uint16_t>& program) {
+    vector<uint8_t> rom;
+    for (uint16_t op : program) {
+        rom.push_back(op >> 8);
+        rom.push_back(op & 0xFF);
+    }
+    return rom;
+}
+
+// runs a small looping program and reports the time per executed instruction
+static void bench_program(const string& name, const vector<uint16_t>& program) {
+    vector<uint8_t> rom = assemble(program);
+
+    double best = 0;
+    for (int r = 0; r < REPEATS; r++) {
+        Chip8 chip8;
+        chip8.seed(1);
+        chip8.load_rom(rom.data(), rom.size());
+
+        double start = now_ns();
+        chip8.step(MICRO_INSTRUCTIONS);
+        double elapsed = now_ns() - start;
+
+        sink = checksum(chip8);
+        if (r == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    report(name, "ns_per_instruction", best / MICRO_INSTRUCTIONS);
+}
+
+// forks a machine that owns memory pages, runs the child for a frame and discards it,
+// the inner loop of a tree search
+static void bench_fork() {
+    // fills a page at 0x300 and one at 0x400, then keeps writing to the first one
+    vector<uint8_t> rom = assemble({ 0xA300, 0xFF55, 0xA400, 0xFF55, 0xA300, 0x70FF, 0xF033, 0x120A });
+
+    Chip8 chip8;
+    chip8.seed(1);
+    chip8.load_rom(rom.data(), rom.size());
+    chip8.step(100);
+
+    double best = 0;
+    for (int r = 0; r < REPEATS; r++) {
+        double start = now_ns();
+        for (unsigned i = 0; i < FORKS; i++) {
+            unique_ptr<Chip8> child = chip8.fork();
+            child->run_frame();
+            sink = child->framebuffer()[0];
+        }
+        double elapsed = now_ns() - start;
+
+        if (r == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    report("fork", "ns_per_fork", best / FORKS);
+}
+
+// a frontend frame with run-ahead: one frame of the machine, then a snapshot of it run
+// RUN_AHEAD frames further and thrown away; snapshot alone is the copy into the reused machine
+static void bench_run_ahead() {
+    vector<uint8_t> rom = assemble({ 0xA300, 0xFF55, 0xA400, 0xFF55, 0xA300, 0x70FF, 0xF033, 0x120A });
+
+    Chip8 chip8;
+    chip8.seed(1);
+    chip8.load_rom(rom.data(), rom.size());
+    chip8.step(100);
+
+    Chip8 ahead;
+    double best_frame = 0, best_snapshot = 0;
+    for (int r = 0; r < REPEATS; r++) {
+        double start = now_ns();
+        for (unsigned i = 0; i < FORKS; i++) {
+            chip8.run_frame();
+            MetricsSuspension shadow; // as the frontend runs it
+            ahead = chip8;
+            ahead.run_frames(RUN_AHEAD);
+            sink = ahead.framebuffer()[0];
+        }
+        double frame = now_ns() - start;
+
+        start = now_ns();
+        for (unsigned i = 0; i < FORKS; i++) {
+            ahead = chip8;
+            sink = ahead.program_counter();
+        }
+        double snapshot = now_ns() - start;
+
+        if (r == 0 || frame < best_frame)
+            best_frame = frame;
+        if (r == 0 || snapshot < best_snapshot)
+            best_snapshot = snapshot;
+    }
+
+    report("run_ahead/" + to_string(RUN_AHEAD), "ns_per_frame", best_frame / FORKS);
+    report("snapshot", "ns_per_snapshot", best_snapshot / FORKS);
+}
+
+// converts a drawn display into texture pixels and into observation bytes, at every SIMD
+// level the CPU supports; the names without a level are the level picked at startup
+static void bench_render() {
+    vector<uint8_t> rom = assemble({ 0xA050, 0x6000, 0x6100, 0xD015, 0x7005, 0x7103, 0x1206 });
+
+    Chip8 chip8;
+    chip8.load_rom(rom.data(), rom.size());
+    chip8.step(1001);
+
+    vector<uint32_t> pixels(64 * 32);
+    vector<uint8_t> bytes(64 * 32);
+
+    auto time = [&](auto expand) {
+        double best = 0;
+        for (int r = 0; r < REPEATS; r++) {
+            double start = now_ns();
+            for (unsigned i = 0; i < RENDER_FRAMES; i++)
+                expand(i);
+            double elapsed = now_ns() - start;
+
+            if (r == 0 || elapsed < best)
+                best = elapsed;
+        }
+        return best / RENDER_FRAMES;
+    };
+    auto expand_pixels = [&](unsigned i) {
+        expand_framebuffer(chip8.framebuffer(), pixels.data(), 64 * sizeof(uint32_t), 0xFFFFFFFF, 0xFF000000 | i);
+        sink = pixels[64 * 32 - 1];
+    };
+    auto expand_bytes = [&](unsigned) {
+        expand_framebuffer_bytes(chip8.framebuffer(), bytes.data());
+        sink = bytes[64 * 32 - 1];
+    };
+
+    report("render_expand", "ns_per_frame", time(expand_pixels));
+    report("observation_expand", "ns_per_frame", time(expand_bytes));
+
+    SimdLevel picked = simd_level();
+    for (int level = SIMD_SCALAR; level <= SIMD_AVX512; level++) {
+        string name = simd_level_name((SimdLevel)level);
+        if (!set_simd_level((SimdLevel)level)) {
+            report_unsupported("render_expand/" + name, "ns_per_frame");
+            report_unsupported("observation_expand/" + name, "ns_per_frame");
+            continue;
+        }
+
+        report("render_expand/" + name, "ns_per_frame", time(expand_pixels));
+        report("observation_expand/" + name, "ns_per_frame", time(expand_bytes));
+    }
+    set_simd_level(picked);
+}
+
+// runs a ROM headless for a fixed number of frames
+static void bench_rom(const filesystem::path& path) {
+    ifstream file(path, ios_base::binary);
+    vector<uint8_t> rom((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+    double best = 0;
+    for (int r = 0; r < REPEATS; r++) {
+        Chip8 chip8;
+        chip8.seed(1); // same path through the ROM on every run
+        if (!chip8.load_rom(rom.data(), rom.size()))
+            return;
+
+        double start = now_ns();
+        for (unsigned f = 0; f < ROM_FRAMES; f++)
+            chip8.run_frame();
+        double elapsed = now_ns() - start;
+
+        sink = checksum(chip8);
+        if (r == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    string name = "rom/" + path.stem().string();
+    for (char& ch : name)
+        if (ch == ' ') ch = '_';
+
+    report(name, "frames_per_sec", ROM_FRAMES / (best / 1e9));
+    report(name, "ns_per_instruction", best / (ROM_FRAMES * Chip8::CYCLES_PER_FRAME));
+}
+
+// steps a batch of environments on all hardware threads with random actions, frame skip 4,
+// with the reward spec of the ROM when there is one
+static void bench_vecenv(const filesystem::path& path) {
+    ifstream file(path, ios_base::binary);
+    vector<uint8_t> rom((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+    VecEnv env(VECENV_SIZE);
+    if (rom.empty() || !env.load_rom(rom.data(), rom.size()))
+        return;
+
+    GameSpec spec;
+    if (spec.load((path.parent_path() / "specs" / path.stem()).string() + ".txt"))
+        env.set_spec(spec);
+
+    vector<uint8_t> observations(VECENV_SIZE * VecEnv::OBSERVATION_SIZE);
+    vector<uint16_t> actions(VECENV_SIZE);
+    vector<float> rewards(VECENV_SIZE);
+    vector<uint8_t> dones(VECENV_SIZE);
+    uint32_t rng = 1;
+
+    double best = 0;
+    for (int r = 0; r < REPEATS; r++) {
+        env.seed(1);
+        env.reset(observations.data());
+
+        double start = now_ns();
+        for (unsigned s = 0; s < VECENV_STEPS; s++) {
+            for (uint16_t& action : actions) {
+                rng ^= rng << 13;
+                rng ^= rng >> 17;
+                rng ^= rng << 5;
+                action = 1 << (rng & 0xF);
+            }
+            env.step(actions.data(), observations.data(), rewards.data(), dones.data());
+        }
+        double elapsed = now_ns() - start;
+
+        sink = observations[observations.size() - 1];
+        if (r == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    report("vecenv/" + path.stem().string(), "env_steps_per_sec", (double)VECENV_SIZE * VECENV_STEPS / (best / 1e9));
+}
+
+// small looping programs, one per instruction of interest
+static void bench_instructions() {
+    // mix of arithmetic, skips and jumps
+    bench_program("dispatch", { 0x6001, 0x6102, 0x8014, 0x7103, 0x8125, 0x3000, 0x8206, 0x4201, 0x9010, 0xA300, 0x1200 });
+    // two sprites per loop at moving, wrapping coordinates
+    bench_program("dxyn", { 0xA050, 0x6000, 0x6100, 0xD01F, 0x7005, 0x7103, 0xD01A, 0x1206 });
+    bench_program("cls", { 0x00E0, 0x00E0, 0x00E0, 0x1200 });
+    bench_program("fx33", { 0x60FF, 0xA300, 0xF033, 0xF033, 0xF033, 0x1202 });
+    bench_program("fx55", { 0xA300, 0xFF55, 0x1200 });
+    bench_program("fx65", { 0xA300, 0xFF65, 0x1200 });
+}
+
+int main(int argc, char* argv[]) {
+    // --roms-only skips the instruction benchmarks, for profile training on real programs
+    bool roms_only = argc > 1 && string(argv[1]) == "--roms-only";
+    int arg = roms_only ? 2 : 1;
+    string rom_dir = argc > arg ? argv[arg] : "roms";
+    cpu_model = read_cpu_model();
+
+    if (!roms_only) {
+        bench_instructions();
+        bench_fork();
+        bench_run_ahead();
+        bench_render();
+    }
+
+    vector<filesystem::path> roms;
+    error_code ec;
+    for (const auto& entry : filesystem::directory_iterator(rom_dir, ec))
+        if (entry.path().extension() == ".ch8")
+            roms.push_back(entry.path());
+    sort(roms.begin(), roms.end());
+
+    for (const auto& path : roms)
+        bench_rom(path);
+
+    bench_vecenv(filesystem::path(rom_dir) / "Pong.ch8");
+
+    return 0;
+}
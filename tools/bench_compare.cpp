@@ -0,0 +1,226 @@
+// Compares benchmark results against a stored baseline.
+//
+// usage: chip8_bench_compare <baseline> <results>...
+//        chip8_bench_compare --speedup <before> <after>
+//
+// All files hold the JSON lines written by chip8_bench. Several results files are runs
+// of the same build, each metric is taken from the run where it was best. A baseline line may add
+// "tolerance":<fraction> (default 0.10) which is the allowed slowdown of that metric.
+// Metrics are only compared when cpu and compiler match, numbers from different
+// hosts say nothing about each other. A baseline metric missing from results of its host
+// counts as a regression; one the results mark "unsupported":true (a SIMD level the CPU
+// lacks) is skipped.
+//
+// exit code: 0 no regressions, 1 regressions found, 2 bad input or nothing comparable
+//
+// --speedup reports how much faster every metric of one build is than the other, and the
+// geometric mean over all metrics, without tolerances or host checks.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+
+using namespace std;
+
+static const double DEFAULT_TOLERANCE = 0.10;
+
+struct Result {
+    double value;
+    double tolerance;
+    string fingerprint; // cpu and compiler
+    bool unsupported; // the host cannot run the benchmark, there is no value
+};
+
+// parses a flat JSON object with string and number values
+static bool parse_line(const string& line, map<string, string>& fields) {
+    size_t i = line.find('{');
+    if (i == string::npos)
+        return false;
+
+    while (true) {
+        size_t key_start = line.find('"', i);
+        if (key_start == string::npos)
+            break;
+        size_t key_end = line.find('"', key_start + 1);
+        size_t colon = line.find(':', key_end);
+        if (key_end == string::npos || colon == string::npos)
+            return false;
+
+        string key = line.substr(key_start + 1, key_end - key_start - 1);
+        size_t value_start = line.find_first_not_of(' ', colon + 1);
+        if (value_start == string::npos)
+            return false;
+
+        if (line[value_start] == '"') {
+            size_t value_end = line.find('"', value_start + 1);
+            if (value_end == string::npos)
+                return false;
+            fields[key] = line.substr(value_start + 1, value_end - value_start - 1);
+            i = value_end + 1;
+        } else {
+            size_t value_end = line.find_first_of(",}", value_start);
+            if (value_end == string::npos)
+                return false;
+            fields[key] = line.substr(value_start, value_end - value_start);
+            i = value_end;
+        }
+    }
+
+    return true;
+}
+
+// reads results keyed by "bench metric"
+static bool read_results(const char* path, map<string, Result>& results) {
+    ifstream file(path);
+    if (!file) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return false;
+    }
+
+    string line;
+    int line_number = 0;
+    while (getline(file, line)) {
+        line_number++;
+        if (line.find_first_not_of(" \t\r") == string::npos)
+            continue;
+
+        map<string, string> fields;
+        bool parsed = parse_line(line, fields);
+        bool unsupported = fields.count("unsupported") && fields["unsupported"] == "true";
+        if (!parsed || !fields.count("bench") || !fields.count("metric") || (!unsupported && !fields.count("value"))) {
+            fprintf(stderr, "%s:%d: malformed result\n", path, line_number);
+            return false;
+        }
+
+        Result result;
+        result.unsupported = unsupported;
+        result.value = unsupported ? 0 : atof(fields["value"].c_str());
+        result.tolerance = fields.count("tolerance") ? atof(fields["tolerance"].c_str()) : DEFAULT_TOLERANCE;
+        result.fingerprint = fields["cpu"] + " / " + fields["compiler"];
+        results[fields["bench"] + " " + fields["metric"]] = result;
+    }
+
+    return true;
+}
+
+// throughput metrics grow when things get faster, timings shrink
+static bool higher_is_better(const string& key) {
+    return key.size() >= 8 && key.compare(key.size() - 8, 8, "_per_sec") == 0;
+}
+
+// merges a run into the best values seen so far
+static void keep_best(map<string, Result>& best, const map<string, Result>& run) {
+    for (const auto& [key, result] : run) {
+        auto it = best.find(key);
+        if (it != best.end() && result.unsupported)
+            continue;
+        if (it == best.end() || it->second.unsupported ||
+            (higher_is_better(key) ? result.value > it->second.value : result.value < it->second.value))
+            best[key] = result;
+    }
+}
+
+static int report_speedup(const char* before_path, const char* after_path) {
+    map<string, Result> before, after;
+    if (!read_results(before_path, before) || !read_results(after_path, after))
+        return 2;
+
+    int compared = 0;
+    double log_sum = 0;
+    for (const auto& [key, old_result] : before) {
+        auto it = after.find(key);
+        if (it == after.end() || old_result.value <= 0 || it->second.value <= 0)
+            continue;
+
+        // above 1 when the second build is faster
+        double speedup = higher_is_better(key) ? it->second.value / old_result.value : old_result.value / it->second.value;
+        printf("%-40s %14.3f -> %14.3f  %.3fx\n", key.c_str(), old_result.value, it->second.value, speedup);
+
+        log_sum += log(speedup);
+        compared++;
+    }
+
+    if (compared == 0) {
+        fprintf(stderr, "No metrics in both files\n");
+        return 2;
+    }
+
+    printf("geometric mean speedup over %d metrics: %.3fx\n", compared, exp(log_sum / compared));
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 4 && string(argv[1]) == "--speedup")
+        return report_speedup(argv[2], argv[3]);
+
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <baseline> <results>...\n       %s --speedup <before> <after>\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    map<string, Result> baseline, results;
+    if (!read_results(argv[1], baseline))
+        return 2;
+    for (int i = 2; i < argc; i++) {
+        map<string, Result> run;
+        if (!read_results(argv[i], run))
+            return 2;
+        keep_best(results, run);
+    }
+
+    set<string> hosts;
+    for (const auto& [key, result] : results)
+        hosts.insert(result.fingerprint);
+
+    int compared = 0, regressions = 0;
+    for (const auto& [key, base] : baseline) {
+        auto it = results.find(key);
+        if (it == results.end()) {
+            if (!hosts.count(base.fingerprint)) {
+                printf("SKIPPED     %-40s host differs\n", key.c_str());
+                continue;
+            }
+
+            // a benchmark that stopped running would otherwise pass unnoticed
+            printf("MISSING     %-40s\n", key.c_str());
+            compared++;
+            regressions++;
+            continue;
+        }
+
+        const Result& current = it->second;
+        if (current.fingerprint != base.fingerprint) {
+            printf("SKIPPED     %-40s host differs (%s)\n", key.c_str(), current.fingerprint.c_str());
+            continue;
+        }
+        if (current.unsupported) {
+            printf("SKIPPED     %-40s not supported on this host\n", key.c_str());
+            continue;
+        }
+
+        // relative slowdown, positive when the current result is worse
+        double change = (current.value - base.value) / base.value;
+        if (higher_is_better(key))
+            change = -change;
+
+        bool regressed = change > base.tolerance;
+        printf("%-11s %-40s %14.3f -> %14.3f  %+6.1f%% (tolerance %.0f%%)\n", regressed ? "REGRESSION" : "ok",
+            key.c_str(), base.value, current.value, change * 100, base.tolerance * 100);
+
+        compared++;
+        if (regressed)
+            regressions++;
+    }
+
+    if (compared == 0) {
+        fprintf(stderr, "No comparable results, record a baseline on this host first\n");
+        return 2;
+    }
+
+    printf("%d of %d metrics regressed\n", regressions, compared);
+    return regressions > 0 ? 1 : 0;
+}
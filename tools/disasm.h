@@ -0,0 +1,65 @@
+// CHIP-8 disassembler, mnemonics follow the instruction table in README.md
+
+#ifndef DISASM_H
+#define DISASM_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+inline std::string disassemble(uint16_t op) {
+    char text[32];
+    unsigned x = (op >> 8) & 0xF, y = (op >> 4) & 0xF;
+    unsigned n = op & 0xF, nn = op & 0xFF, nnn = op & 0xFFF;
+
+    switch (op >> 12) {
+        case 0x0:
+            if (op == 0x00E0) return "CLS";
+            if (op == 0x00EE) return "RET";
+            break;
+        case 0x1: snprintf(text, sizeof(text), "JP %03X", nnn); return text;
+        case 0x2: snprintf(text, sizeof(text), "CALL %03X", nnn); return text;
+        case 0x3: snprintf(text, sizeof(text), "SE V%X, %02X", x, nn); return text;
+        case 0x4: snprintf(text, sizeof(text), "SNE V%X, %02X", x, nn); return text;
+        case 0x5:
+            if (n == 0) { snprintf(text, sizeof(text), "SE V%X, V%X", x, y); return text; }
+            break;
+        case 0x6: snprintf(text, sizeof(text), "LD V%X, %02X", x, nn); return text;
+        case 0x7: snprintf(text, sizeof(text), "ADD V%X, %02X", x, nn); return text;
+        case 0x8: {
+            static const char* names[16] = { "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+                                             NULL, NULL, NULL, NULL, NULL, NULL, "SHL", NULL };
+            if (names[n]) { snprintf(text, sizeof(text), "%s V%X, V%X", names[n], x, y); return text; }
+            break;
+        }
+        case 0x9:
+            if (n == 0) { snprintf(text, sizeof(text), "SNE V%X, V%X", x, y); return text; }
+            break;
+        case 0xA: snprintf(text, sizeof(text), "LD I, %03X", nnn); return text;
+        case 0xB: snprintf(text, sizeof(text), "JP V0, %03X", nnn); return text;
+        case 0xC: snprintf(text, sizeof(text), "RND V%X, %02X", x, nn); return text;
+        case 0xD: snprintf(text, sizeof(text), "DRW V%X, V%X, %X", x, y, n); return text;
+        case 0xE:
+            if (nn == 0x9E) { snprintf(text, sizeof(text), "SKP V%X", x); return text; }
+            if (nn == 0xA1) { snprintf(text, sizeof(text), "SKNP V%X", x); return text; }
+            break;
+        case 0xF:
+            switch (nn) {
+                case 0x07: snprintf(text, sizeof(text), "LD V%X, DT", x); return text;
+                case 0x0A: snprintf(text, sizeof(text), "LD V%X, K", x); return text;
+                case 0x15: snprintf(text, sizeof(text), "LD DT, V%X", x); return text;
+                case 0x18: snprintf(text, sizeof(text), "LD ST, V%X", x); return text;
+                case 0x1E: snprintf(text, sizeof(text), "ADD I, V%X", x); return text;
+                case 0x29: snprintf(text, sizeof(text), "LD F, V%X", x); return text;
+                case 0x33: snprintf(text, sizeof(text), "LD B, V%X", x); return text;
+                case 0x55: snprintf(text, sizeof(text), "LD [I], V%X", x); return text;
+                case 0x65: snprintf(text, sizeof(text), "LD V%X, [I]", x); return text;
+            }
+            break;
+    }
+
+    snprintf(text, sizeof(text), "DW %04X", op); // not an instruction
+    return text;
+}
+
+#endif
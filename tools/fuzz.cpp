@@ -0,0 +1,141 @@
+// In-process fuzzing harness for the CPU core.
+//
+// The input bytes are loaded as a ROM and run for a bounded number of frames. The core
+// is built with CHIP8_CHECKED so any access outside of memory aborts, and the harness
+// checks the stack pointer and program counter after every frame. With CHIP8_ZOBRIST it also checks at the end
+// of every run that the incrementally kept state hash matches one computed from scratch.
+//
+// With libFuzzer:  clang++ -fsanitize=fuzzer,address -DCHIP8_CHECKED -DCHIP8_ZOBRIST -DCHIP8_LIBFUZZER tools/fuzz.cpp chip8.cpp metrics.cpp
+// Standalone:      chip8_fuzz [--iterations N] [--frames F] [seed file or directory]...
+//   runs the seeds, then random mutations of them, and reports executions per second.
+
+#include "../chip8.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+static unsigned max_frames = 16;
+
+static void check(bool ok, const char* what) {
+    if (!ok) {
+        fprintf(stderr, "invariant violated: %s\n", what);
+        abort();
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    static Chip8 chip8;
+
+    // a pristine machine first, so the boot image load_rom() builds from it holds the input
+    // alone; loading boots the machine the way reset_keep_rom() does, sharing the image
+    chip8.reset();
+    chip8.load_rom(data, size < Chip8::MAX_ROM_SIZE ? size : Chip8::MAX_ROM_SIZE);
+    chip8.set_quirks(size > 0 ? data[size - 1] & 7 : 0); // every quirk combination, chosen by the input
+
+    for (unsigned f = 0; f < max_frames; f++) {
+        chip8.set_key(f & 0xF, f & 1); // some input so key instructions take both paths
+        chip8.run_frame();
+
+        check(chip8.stack_pointer() <= 16, "sp within the stack");
+        check(chip8.program_counter() < 4096, "pc within memory");
+    }
+
+#ifdef CHIP8_ZOBRIST
+    static Chip8State state;
+    chip8.save_state(state);
+    check(chip8.state_hash() == Chip8::hash_state(state), "state hash kept up to date");
+#endif
+
+    return 0;
+}
+
+#ifndef CHIP8_LIBFUZZER
+
+using namespace std;
+
+static vector<uint8_t> read_file(const filesystem::path& path) {
+    ifstream file(path, ios_base::binary);
+    return vector<uint8_t>(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+}
+
+// small random edits, biased towards whole instructions
+static void mutate(vector<uint8_t>& rom, uint64_t& rng) {
+    auto next = [&]() {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        return rng;
+    };
+
+    if (rom.size() < 2)
+        rom.resize(2);
+
+    unsigned edits = 1 + next() % 4;
+    for (unsigned e = 0; e < edits; e++) {
+        size_t pos = next() % rom.size();
+        switch (next() % 4) {
+            case 0: rom[pos] ^= 1 << (next() % 8); break; // flip a bit
+            case 1: rom[pos] = (uint8_t)next(); break; // random byte
+            case 2: // random instruction at an even address
+                pos &= ~(size_t)1;
+                rom[pos] = (uint8_t)next();
+                rom[pos + 1 < rom.size() ? pos + 1 : pos] = (uint8_t)next();
+                break;
+            case 3: // point I at the end of memory, the edge that matters for FX33/FX55/FX65/DXYN
+                pos &= ~(size_t)1;
+                rom[pos] = 0xAF;
+                rom[pos + 1 < rom.size() ? pos + 1 : pos] = (uint8_t)(0xF0 | next());
+                break;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t iterations = 1000000;
+    vector<vector<uint8_t>> corpus;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--iterations" && i + 1 < argc) {
+            iterations = strtoull(argv[++i], NULL, 10);
+        } else if (arg == "--frames" && i + 1 < argc) {
+            max_frames = atoi(argv[++i]);
+        } else if (filesystem::is_directory(arg)) {
+            for (const auto& entry : filesystem::directory_iterator(arg))
+                if (entry.is_regular_file())
+                    corpus.push_back(read_file(entry.path()));
+        } else {
+            corpus.push_back(read_file(arg));
+        }
+    }
+
+    if (corpus.empty())
+        corpus.push_back(vector<uint8_t>(64, 0));
+
+    for (const auto& rom : corpus)
+        LLVMFuzzerTestOneInput(rom.data(), rom.size());
+
+    uint64_t rng = 0x2545F4914F6CDD1Dull;
+    vector<uint8_t> rom;
+
+    auto start = chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iterations; i++) {
+        rom = corpus[i % corpus.size()];
+        mutate(rom, rng);
+        LLVMFuzzerTestOneInput(rom.data(), rom.size());
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    printf("%llu executions in %.2f s, %.0f executions/s\n", (unsigned long long)iterations, seconds,
+        seconds > 0 ? iterations / seconds : 0.0);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,223 @@
+// Golden frame regression tests, every script runs one ROM headless on its own thread.
+//
+// usage: chip8_golden [--update] [script directory] [rom directory]
+//
+// Script format, one command per line, frames are counted from 1:
+//   rom <file name>          ROM from the rom directory
+//   seed <number>            seed of the random number generator
+//   press <frame> <key>      key 0-F goes down before the frame runs
+//   release <frame> <key>    key 0-F goes up before the frame runs
+//   frame <frame> <hash>     display hash after the frame ran
+// --update rewrites the hashes of frame lines with the current results.
+
+#include "../chip8.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+struct Event {
+    unsigned frame;
+    int key; // -1 for a frame check
+    bool pressed;
+    size_t line; // index of the script line
+};
+
+struct Script {
+    filesystem::path path;
+    vector<string> lines;
+    string rom;
+    uint32_t seed = 0;
+    vector<Event> events;
+
+    vector<uint64_t> hashes; // result of every frame check, in event order
+    string error;
+    int failures = 0;
+};
+
+// FNV-1a over the packed display rows
+static uint64_t display_hash(const Chip8& chip8) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (int y = 0; y < 32; y++) {
+        uint64_t row = chip8.framebuffer()[y];
+        for (int i = 0; i < 8; i++) {
+            hash ^= (row >> (56 - i * 8)) & 0xFF;
+            hash *= 0x100000001B3ull;
+        }
+    }
+    return hash;
+}
+
+static bool parse(Script& script) {
+    ifstream file(script.path);
+    string line;
+    while (getline(file, line))
+        script.lines.push_back(line);
+
+    for (size_t i = 0; i < script.lines.size(); i++) {
+        istringstream in(script.lines[i]);
+        string command;
+        if (!(in >> command) || command[0] == '#')
+            continue;
+
+        if (command == "rom") {
+            getline(in >> ws, script.rom);
+        } else if (command == "seed") {
+            in >> script.seed;
+        } else if (command == "press" || command == "release" || command == "frame") {
+            Event event;
+            event.line = i;
+            event.pressed = command == "press";
+            event.key = -1;
+            in >> event.frame;
+            if (command != "frame")
+                in >> hex >> event.key;
+            if (!in || event.frame == 0) {
+                script.error = "line " + to_string(i + 1) + ": bad " + command;
+                return false;
+            }
+            script.events.push_back(event);
+        } else {
+            script.error = "line " + to_string(i + 1) + ": unknown command " + command;
+            return false;
+        }
+    }
+
+    if (script.rom.empty()) {
+        script.error = "no rom given";
+        return false;
+    }
+
+    // key changes come before the checks of the same frame
+    stable_sort(script.events.begin(), script.events.end(), [](const Event& a, const Event& b) {
+        return a.frame < b.frame;
+    });
+    return true;
+}
+
+static void run(Script& script, const filesystem::path& rom_dir) {
+    if (!parse(script))
+        return;
+
+    ifstream file(rom_dir / script.rom, ios_base::binary);
+    vector<uint8_t> rom;
+    if (file)
+        rom.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+
+    Chip8 chip8;
+    chip8.seed(script.seed);
+    if (rom.empty() || !chip8.load_rom(rom.data(), rom.size())) {
+        script.error = "cannot load " + script.rom;
+        return;
+    }
+
+    unsigned frame = 0;
+    for (const Event& event : script.events) {
+        if (event.key >= 0) {
+            while (frame + 1 < event.frame) {
+                chip8.run_frame();
+                frame++;
+            }
+            chip8.set_key(event.key, event.pressed);
+        } else {
+            while (frame < event.frame) {
+                chip8.run_frame();
+                frame++;
+            }
+            script.hashes.push_back(display_hash(chip8));
+        }
+    }
+}
+
+// compares the hashes with the script, or writes them into it
+static void check(Script& script, bool update) {
+    size_t n = 0;
+    for (const Event& event : script.events) {
+        if (event.key >= 0)
+            continue;
+
+        char actual[17];
+        snprintf(actual, sizeof(actual), "%016llx", (unsigned long long)script.hashes[n++]);
+
+        istringstream in(script.lines[event.line]);
+        string command, expected;
+        unsigned frame;
+        in >> command >> frame >> expected;
+
+        if (update) {
+            script.lines[event.line] = "frame " + to_string(frame) + " " + actual;
+        } else if (expected != actual) {
+            printf("FAIL %s: frame %u expected %s, got %s\n", script.path.filename().string().c_str(), frame,
+                expected.empty() ? "(none)" : expected.c_str(), actual);
+            script.failures++;
+        }
+    }
+
+    if (update) {
+        ofstream file(script.path);
+        for (const string& line : script.lines)
+            file << line << "\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    bool update = false;
+    vector<string> dirs;
+    for (int i = 1; i < argc; i++) {
+        if (string(argv[i]) == "--update")
+            update = true;
+        else
+            dirs.push_back(argv[i]);
+    }
+
+    filesystem::path script_dir = dirs.size() > 0 ? dirs[0] : "tools/golden";
+    filesystem::path rom_dir = dirs.size() > 1 ? dirs[1] : "roms";
+
+    vector<Script> scripts;
+    error_code ec;
+    for (const auto& entry : filesystem::directory_iterator(script_dir, ec)) {
+        if (entry.path().extension() == ".txt") {
+            scripts.emplace_back();
+            scripts.back().path = entry.path();
+        }
+    }
+    sort(scripts.begin(), scripts.end(), [](const Script& a, const Script& b) { return a.path < b.path; });
+
+    if (scripts.empty()) {
+        fprintf(stderr, "No scripts in %s\n", script_dir.string().c_str());
+        return 1;
+    }
+
+    // every ROM runs on its own thread
+    vector<thread> threads;
+    for (Script& script : scripts)
+        threads.emplace_back(run, ref(script), rom_dir);
+    for (thread& t : threads)
+        t.join();
+
+    int failed = 0;
+    for (Script& script : scripts) {
+        if (!script.error.empty()) {
+            printf("ERROR %s: %s\n", script.path.filename().string().c_str(), script.error.c_str());
+            failed++;
+            continue;
+        }
+
+        check(script, update);
+        if (script.failures > 0)
+            failed++;
+        else
+            printf("%s %s\n", update ? "UPDATED" : "ok", script.path.filename().string().c_str());
+    }
+
+    printf("%d of %zu scripts failed\n", failed, scripts.size());
+    return failed > 0 ? 1 : 0;
+}
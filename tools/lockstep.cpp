@@ -0,0 +1,232 @@
+// Differential lockstep checker, runs two cores on the same ROM and inputs and
+// compares their whole machine state every N instructions.
+//
+// usage: chip8_lockstep [--every N] [--frames F] [--seed S] [--quirks MASK] rom...
+//
+// Both cores start from the same state and see the same key presses, and follow the
+// same Chip8::QUIRK_ bits. States are compared through their 64-bit Zobrist hash at every
+// checkpoint; the core keeps its hash up to date as it runs (built with CHIP8_ZOBRIST),
+// only the reference is hashed whole. When the hashes differ both cores are rewound to
+// the last matching checkpoint and stepped one instruction at a time to find the first
+// instruction whose effects differ.
+
+#include "../chip8.h"
+#include "disasm.h"
+#include "reference.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static const unsigned KEY_PERIOD = 20; // frames between changes of the pressed keys
+static const int WINDOW = 4; // instructions shown before and after the failing one
+
+struct Options {
+    unsigned every = 1000;
+    unsigned frames = 6000;
+    uint32_t seed = 1;
+    uint8_t quirks = 0;
+};
+
+// keys held during a frame, at most two at a time so games see real input
+static uint16_t keys_for_frame(uint32_t seed, uint64_t frame) {
+    uint64_t h = (frame / KEY_PERIOD + 1) * 0x9E3779B97F4A7C15ull ^ seed;
+    h ^= h >> 31;
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 29;
+    return (uint16_t)((1u << (h & 0xF)) | ((h & 0x100) ? 1u << ((h >> 4) & 0xF) : 0));
+}
+
+// executes the instruction with the given global number, input and timers follow the frame grid
+template <class Core>
+static void execute(Core& core, uint64_t instr, uint32_t seed) {
+    if (instr % Chip8::CYCLES_PER_FRAME == 0) {
+        uint16_t keys = keys_for_frame(seed, instr / Chip8::CYCLES_PER_FRAME);
+        for (int k = 0; k < 16; k++)
+            core.set_key(k, (keys >> k) & 1);
+    }
+
+    core.step(1);
+
+    if ((instr + 1) % Chip8::CYCLES_PER_FRAME == 0)
+        core.tick_timers();
+}
+
+static uint64_t digest(const Chip8& core) {
+    return core.state_hash();
+}
+
+static uint64_t digest(const ReferenceChip8& core) {
+    Chip8State state;
+    core.save_state(state);
+    return Chip8::hash_state(state);
+}
+
+// prints every field that differs, returns number of differences
+static int print_differences(const Chip8State& a, const Chip8State& b) {
+    int differences = 0;
+    auto field = [&](const char* name, unsigned x, unsigned y) {
+        if (x != y) {
+            printf("    %-12s %6X != %X\n", name, x, y);
+            differences++;
+        }
+    };
+
+    char name[16];
+    field("pc", a.pc, b.pc);
+    field("index", a.index, b.index);
+    field("sp", a.sp, b.sp);
+    for (int i = 0; i < 16; i++) {
+        snprintf(name, sizeof(name), "v[%X]", i);
+        field(name, a.v[i], b.v[i]);
+    }
+    for (int i = 0; i < 16; i++) {
+        snprintf(name, sizeof(name), "stack[%d]", i);
+        field(name, a.stack[i], b.stack[i]);
+    }
+    field("delay_timer", a.delay_timer, b.delay_timer);
+    field("sound_timer", a.sound_timer, b.sound_timer);
+    field("keys", a.keys, b.keys);
+    field("rng_state", a.rng_state, b.rng_state);
+    for (int i = 0; i < 4096; i++) {
+        snprintf(name, sizeof(name), "memory[%03X]", i);
+        field(name, a.memory[i], b.memory[i]);
+    }
+    for (int y = 0; y < 32; y++) {
+        if (a.display[y] != b.display[y]) {
+            printf("    display[%2d] %016llX != %016llX\n", y, (unsigned long long)a.display[y], (unsigned long long)b.display[y]);
+            differences++;
+        }
+    }
+
+    return differences;
+}
+
+static void print_window(const Chip8State& s) {
+    for (int i = -WINDOW; i <= WINDOW; i++) {
+        int addr = s.pc + i * 2;
+        if (addr < 0 || addr + 1 >= 4096)
+            continue;
+
+        uint16_t op = (s.memory[addr] << 8) | s.memory[addr + 1];
+        printf("  %s %03X  %04X  %s\n", i == 0 ? ">" : " ", addr, op, disassemble(op).c_str());
+    }
+}
+
+// steps both cores from a matching checkpoint until they first disagree
+template <class CoreA, class CoreB>
+static void locate(CoreA& a, CoreB& b, const CoreA& checkpoint, uint64_t instr, uint64_t end, uint32_t seed) {
+    Chip8State before, after_a, after_b;
+    checkpoint.save_state(before);
+    a = checkpoint;
+    b.load_state(before);
+
+    for (; instr < end; instr++) {
+        a.save_state(before);
+        execute(a, instr, seed);
+        execute(b, instr, seed);
+
+        if (digest(a) != digest(b)) {
+            a.save_state(after_a);
+            b.save_state(after_b);
+            printf("  first difference at instruction %llu (frame %llu):\n", (unsigned long long)instr,
+                (unsigned long long)(instr / Chip8::CYCLES_PER_FRAME));
+            print_window(before);
+            printf("  state after it (tested != reference):\n");
+            print_differences(after_a, after_b);
+            return;
+        }
+    }
+
+    printf("  cores diverged but the difference could not be reproduced\n");
+}
+
+// runs both cores on a ROM, returns false on divergence
+template <class CoreA, class CoreB>
+static bool run_lockstep(CoreA& a, CoreB& b, const Chip8State& initial, const Options& options) {
+    a.load_state(initial);
+    b.load_state(initial);
+
+    CoreA checkpoint = a; // shares its memory with a until one of them writes
+    uint64_t checkpoint_instr = 0;
+    uint64_t total = (uint64_t)options.frames * Chip8::CYCLES_PER_FRAME;
+
+    for (uint64_t instr = 0; instr < total; instr++) {
+        execute(a, instr, options.seed);
+        execute(b, instr, options.seed);
+
+        if ((instr + 1) % options.every != 0 && instr + 1 != total)
+            continue;
+
+        if (digest(a) != digest(b)) {
+            locate(a, b, checkpoint, checkpoint_instr, instr + 1, options.seed);
+            return false;
+        }
+
+        checkpoint = a;
+        checkpoint_instr = instr + 1;
+    }
+
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    vector<string> roms;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--every" && i + 1 < argc)
+            options.every = max(1, atoi(argv[++i]));
+        else if (arg == "--frames" && i + 1 < argc)
+            options.frames = atoi(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc)
+            options.seed = atoi(argv[++i]);
+        else if (arg == "--quirks" && i + 1 < argc)
+            options.quirks = (uint8_t)strtoul(argv[++i], NULL, 0);
+        else
+            roms.push_back(arg);
+    }
+
+    if (roms.empty()) {
+        fprintf(stderr, "usage: %s [--every N] [--frames F] [--seed S] [--quirks MASK] rom...\n", argv[0]);
+        return 2;
+    }
+
+    int diverged = 0;
+    for (const string& path : roms) {
+        ifstream file(path, ios_base::binary);
+        vector<uint8_t> rom;
+        if (file)
+            rom.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+
+        Chip8 chip8;
+        chip8.seed(options.seed);
+        chip8.set_quirks(options.quirks);
+        if (rom.empty() || !chip8.load_rom(rom.data(), rom.size())) {
+            printf("ERROR %s: cannot load\n", path.c_str());
+            diverged++;
+            continue;
+        }
+
+        Chip8State initial;
+        chip8.save_state(initial);
+
+        ReferenceChip8 reference;
+        reference.set_quirks(options.quirks);
+        if (run_lockstep(chip8, reference, initial, options)) {
+            printf("ok %s\n", path.c_str());
+        } else {
+            printf("DIVERGED %s\n", path.c_str());
+            diverged++;
+        }
+    }
+
+    return diverged > 0 ? 1 : 0;
+}
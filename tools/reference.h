@@ -0,0 +1,564 @@
+// Reference interpreter, the straightforward switch interpreter with one bool per pixel.
+// Optimized cores are checked against it instruction by instruction (see lockstep.cpp),
+// so keep it simple and obviously correct rather than fast.
+
+#ifndef REFERENCE_H
+#define REFERENCE_H
+
+#include "../chip8.h"
+
+#include <cstdint>
+#include <cstring>
+
+class ReferenceChip8 {
+private:
+    uint8_t memory[4096];
+    bool display[32][64];
+    bool draw_flag;
+
+    uint16_t pc;
+    uint16_t index;
+
+    uint16_t stack[16];
+    uint8_t sp;
+
+    uint8_t v[16];
+
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+
+    bool keyboard[16];
+
+    uint32_t rng_state;
+
+    uint8_t quirks = 0; // Chip8::QUIRK_ bits
+
+    void single_cycle() {
+        uint16_t op = (memory[pc & 0xFFF] << 8) | memory[(pc + 1) & 0xFFF]; // reading operation code
+
+        uint16_t addr;
+        uint8_t reg, reg1, reg2, val;
+        uint8_t op_subcode;
+        uint16_t temp;
+
+        uint8_t mask, rnd;
+
+        uint8_t op_code = op >> 12;
+        switch (op_code) {
+            case 0:
+                switch (op) {
+                    case 0x00E0:
+                        // 00E0 - clear the display
+                        memset(display, 0, sizeof(display));
+                        draw_flag = true;
+
+                        pc = (pc + 2) & 0xFFF;
+                        break;
+
+                    case 0x00EE:
+                        // 00EE - returns from subrutine
+                        if (sp > 0) {
+                            sp--;
+                            pc = stack[sp];
+                        }
+
+                        pc = (pc + 2) & 0xFFF;
+                        break;
+                }
+
+                break;
+
+            case 1:
+                // 1NNN - Jumps to address NNN
+                addr = op & 0x0FFF;
+                pc = addr;
+
+                break;
+
+            case 2:
+                // 2NNN - Calls subrutine at NNN
+                addr = op & 0x0FFF;
+                if (sp < 16) {
+                    stack[sp] = pc;
+                    sp++;
+                }
+
+                pc = addr;
+
+                break;
+
+            case 3:
+                // 3XNN - Skips the next instruction if VX equals NN
+                reg = (op & 0x0F00) >> 8;
+                val = op & 0x00FF;
+
+                if (v[reg] == val)
+                    pc = (pc + 2) & 0xFFF;
+
+                pc = (pc + 2) & 0xFFF;
+                break;
+
+            case 4:
+                // 4XNN - Skips the next instruction if VX does not equal NN
+                reg = (op & 0x0F00) >> 8;
+                val = op & 0x00FF;
+
+                if (v[reg] != val)
+                    pc = (pc + 2) & 0xFFF;
+
+                pc = (pc + 2) & 0xFFF;
+                break;
+
+            case 5:
+                // 5XY0 - Skips the next instruction if VX equals VY
+                reg1 = (op & 0x0F00) >> 8;
+                reg2 = (op & 0x00F0) >> 4;
+
+                if (v[reg1] == v[reg2])
+                    pc = (pc + 2) & 0xFFF;
+
+                pc = (pc + 2) & 0xFFF;
+                break;
+
+            case 6:
+                // 6XNN - Set VX to NN
+                reg = (op & 0x0F00) >> 8;
+                val = op & 0x00FF;
+
+                v[reg] = val;
+
+                pc = (pc + 2) & 0xFFF;
+                break;
+
+            case 7:
+                // 7XNN - Adds NN to VX (carry flag is not changed)
+                reg = (op & 0x0F00) >> 8;
+                val = op & 0x00FF;
+
+                v[reg] += val;
+
+                pc = (pc + 2) & 0xFFF;
+                break;
+
+            case 8:
+                op_subcode = op & 0x000F; // last 4 bits
+                switch (op_subcode) {
+                    case 0:
+                        // 8XY0 - Sets VX to the values of VY
+                        reg1 = (op & 0x0F00) >> 8;
+                        reg2 = (op & 0x00F0) >> 4;
+
+                        v[reg1] = v[reg2];
+
+                        pc = (pc + 2) & 0xFFF;
+                        break;
+
+                    case 1:
+                        // 8XY1 - Sets VX to VX | VY
+                        reg1 = (op & 0x0F00) >> 8;
+                        reg2 = (op & 0x00F0) >> 4;
+
+                        v[reg1] = v[reg1] | v[reg2];
+                        v[0xF] = 0;
+
+                        pc = (pc + 2) & 0xFFF;
+                        break;
+
+                    case 2:
+                        // 8XY2 - Sets VX to VX & VY
+                        reg1 = (op & 0x0F00) >> 8;
+                        reg2 = (op & 0x00F0) >> 4;
+
+                        v[reg1] = v[reg1] & v[reg2];
+                        v[0xF] = 0;
+
+                        pc = (pc + 2) & 0xFFF;
+                        break;
+
+                    case 3:
+                        // 8XY3 - Sets VX to VX ^ VY
+                        reg1 = (op & 0x0F00) >> 8;
+                        reg2 = (op & 0x00F0) >> 4;
+
+                        v[reg1] = v[reg1] ^ v[reg2];
+                        v[0xF] = 0;
+
+                        pc = (pc + 2) & 0xFFF;
+                        break;
+
+                    case 4:
+                        // 8XY4 - Adds VY to VX. VF is set to 1 when there's an overflow, and to 0 when there is not
+                        reg1 = (op & 0x0F00) >> 8;
+                        reg2 = (op & 0x00F0) >> 4;
+
+                        temp = v[reg1] + v[reg2];
+
+                        v[reg1] += v[reg2];
+                        v[reg1] = (uint8_t)v[reg1];
+
+                        if (temp > 0xFF)
+                            v[0xF] = 1;
+                        else
+                            v[0xF] = 0;
+
+                        pc = (pc + 2) & 0xFFF;
+                        break;
+
+                    case 5:
+                        // 8XY5 - VY is subtracted from VX. VF is set to 0 when there's an underflow, and 1 when there is not
+                        reg1 = (op & 0x0F00) >> 8;
+                        reg2 = (op & 0x00F0) >> 4;
+
+                        temp = v[reg1];
+                        v[reg1] = (uint8_t)(v[reg1] - v[reg2]);
+
+                        if ((uint8_t)temp < v[reg2])
+                            v[0xF] = 0;
+                        else
+                            v[0xF] = 1;
+
+                        pc = (pc + 2) & 0xFFF;
+                        break;
+
+                    case 6:
+                        // 8XY6 - Shifts VX to the right by 1 and stores the least significant bit of VX prior to the shift into VF
+                        reg1 = (op & 0x0F00) >> 8;
+                        reg2 = (op & 0x00F0) >> 4;
+
+                        if (!(quirks & Chip8::QUIRK_SHIFT))
+                            v[reg1] = v[reg2];
+                        temp = (uint16_t)(v[reg1] & 0x01);
+                        v[reg1] >>= 1;
+                        v[0xF] = (uint8_t)temp;
+
+                        pc = (pc + 2) & 0xFFF;
+                        break;
+
+                    case 7:
+                        // 8XY7 - Sets VX to VY minus VX. VF is set to 0 when there's an underflow, and 1 when there is not.
+                        reg1 = (op & 0x0F00) >> 8;
+                        reg2 = (op & 0x00F0) >> 4;
+
+                        v[reg1] = (uint8_t)(v[reg2] - v[reg1]);
+
+                         if (v[reg1] > v[reg2])
+                            v[0xF] = 0;
+                        else
+                            v[0xF] = 1;
+
+                        pc = (pc + 2) & 0xFFF;
+                        break;
+
+                    case 14:
+                        // 8XYE - Shifts VX to the left by 1 and sets VF to 1 if the most significant bit of VX prior to that shift was set, 
+                        // or to 0 if it was unset.
+                        reg1 = (op & 0x0F00) >> 8;
+                        reg2 = (op & 0x00F0) >> 4;
+
+                        if (!(quirks & Chip8::QUIRK_SHIFT))
+                            v[reg1] = v[reg2];
+                        temp = (uint16_t)(v[reg1] >> 7);
+                        v[reg1] <<= 1;
+                        v[0xF] = (uint8_t)temp;
+
+                        pc = (pc + 2) & 0xFFF;
+                        break;
+                }
+
+                break;
+
+            case 9:
+                // 9XY0 - Skips the next instruction if VX does not equal VY.
+                reg1 = (op & 0x0F00) >> 8;
+                reg2 = (op & 0x00F0) >> 4;
+
+                if (v[reg1] != v[reg2])
+                    pc = (pc + 2) & 0xFFF;
+
+                pc = (pc + 2) & 0xFFF;
+                break;
+
+            case 10:
+                // ANNN - Sets I to the address NNN
+                addr = op & 0x0FFF;
+                index = addr;
+
+                pc = (pc + 2) & 0xFFF;
+                break;
+
+            case 11:
+                // BNNN - Jumps to the address NNN plus V0, or XNN plus VX with QUIRK_JUMP
+                addr = op & 0x0FFF;
+                reg = quirks & Chip8::QUIRK_JUMP ? (op & 0x0F00) >> 8 : 0;
+                pc = (addr + v[reg]) & 0xFFF;
+
+                break;
+
+            case 12:
+                // CXNN - Sets VX to the result of a bitwise and operation on a random number
+                reg = (op & 0x0F00) >> 8;
+                mask = op & 0x00FF;
+
+                rng_state ^= rng_state << 13;
+                rng_state ^= rng_state >> 17;
+                rng_state ^= rng_state << 5;
+                rnd = rng_state >> 24; // between 0 and 256
+                rnd &= mask;
+
+                v[reg] = rnd;
+
+                pc = (pc + 2) & 0xFFF;
+                break;
+
+            case 13: {
+                // DXYN - Draws a sprite at coordinate (VX, VY) that is 8 pixels wide and N pixels long
+                reg1 = (op & 0x0F00) >> 8; // register where X coordinate is stored
+                reg2 = (op & 0x00F0) >> 4; // register where Y coorfinate is stored
+                uint8_t height = op & 0x000F; // N
+                uint8_t width = 8; // every sprite is 8 pixels wide
+
+                // read coordinates
+                int x = v[reg1];
+                int y = v[reg2];
+
+                v[0xF] = 0;  // Reset collision flag
+
+                for (int i = 0; i < height; i++) {
+                    uint8_t pixel = memory[(index + i) & 0xFFF];
+
+                    for (int j = 0; j < width; j++) {
+                        if ((pixel & (0x80 >> j)) != 0) {
+                            // calculate coorinates
+                            int xpos = (x + j) % 64;
+                            int ypos = (y + i) % 32;
+
+                            // if pixel was changed from set to unset, set collision flag
+                            if (display[ypos][xpos] == 1)
+                                v[0xF] = 1;
+
+                            // xoring
+                            display[ypos][xpos] ^= 1;
+                        }
+                    }
+                }
+
+                // set draw flag
+                draw_flag = true;
+                pc = (pc + 2) & 0xFFF;
+                break;
+            }
+
+            case 14:
+                op_subcode = op & 0x00FF;
+                switch (op_subcode) {
+                    case 0x9E:
+                        // EX9E - Skips the next instruction if the key stored in VX is pressed
+                        reg = (op & 0x0F00) >> 8; // key
+
+                        if (keyboard[v[reg] & 0xF] == 1)
+                            pc = (pc + 2) & 0xFFF;
+
+                        pc = (pc + 2) & 0xFFF;
+                        break;
+
+                    case 0xA1:
+                        // EXA1 - Skips the next instruction if the key stored in VX is not pressed
+                        reg = (op & 0x0F00) >> 8; // key
+                        if (keyboard[v[reg] & 0xF] == 0)
+                            pc = (pc + 2) & 0xFFF;
+
+                        pc = (pc + 2) & 0xFFF;
+                        break;
+                }
+
+                break;
+
+            case 15: {
+                op_subcode = op & 0x00FF;
+                switch (op_subcode) {
+                    case 0x07: {
+                        // FX07 - Sets VX to the value of the delay timer
+                        reg = (op & 0x0F00) >> 8;
+                        v[reg] = delay_timer;
+
+                        pc = (pc + 2) & 0xFFF;
+                        break;
+                    }
+
+                    case 0x0A: {
+                        // FX0A - A key press is awaited, and then stored in VX 
+                        // (blocking operation, all instruction halted until next key event, 
+                        // delay and sound timers should continue processing)
+                        reg = (op & 0x0F00) >> 8;
+                        bool key_pressed = false;
+
+                        for (int i = 0; i < 16; i++) {
+                            if (keyboard[i]) {
+                                key_pressed = true;
+                                v[reg] = (uint8_t)i;
+                            }
+                        }
+
+                        if (key_pressed)
+                            pc = (pc + 2) & 0xFFF;
+
+                        break;
+                    }
+
+                    case 0x15: {
+                        // FX15 - Sets the delay timer to VX
+                        reg = (op & 0x0F00) >> 8;
+                        delay_timer = v[reg];
+
+                        pc = (pc + 2) & 0xFFF;
+                        break;
+                    }
+
+                    case 0x18: {
+                        // FX18 - Sets the sound timer to VX
+                        reg = (op & 0x0F00) >> 8;
+                        sound_timer = v[reg];
+
+                        pc = (pc + 2) & 0xFFF;
+                        break;
+                    }
+
+                    case 0x1E: {
+                        // FX1E - Adds VX to I
+                        reg = (op & 0x0F00) >> 8;
+
+                        index = (uint16_t)(index + v[reg]);
+
+                        pc = (pc + 2) & 0xFFF;
+                        break;
+                    }
+
+                    case 0x29: {
+                        // FX29 - Sets I to the location of the sprite for the character in VX
+                        reg = (op & 0x0F00) >> 8;
+                        index = 0x050 + v[reg] * 0x5; // each char is 5 locations long
+
+                        pc = (pc + 2) & 0xFFF;
+                        break;
+                    }
+
+                    case 0x33: {
+                        // FX33 - Stores the binary-coded decimal representation of VX, 
+                        // with the hundreds digit in memory at location in I, 
+                        // the tens digit at location I+1, and the ones digit at location I+2.
+                        reg = (op & 0x0F00) >> 8;
+
+                        // 255 -> memory[index] = 2, memory[index + 1] = 5, memory[index + 2] = 5
+                        memory[index & 0xFFF] = (uint8_t)(v[reg] / 100);
+                        memory[(index + 1) & 0xFFF] = (uint8_t)((uint8_t)(v[reg] / 10) % 10);
+                        memory[(index + 2) & 0xFFF] = (uint8_t)(v[reg] % 10);
+
+                        pc = (pc + 2) & 0xFFF;
+                        break;
+                    }
+
+                    case 0x55: {
+                        // FX55 - Stores from V0 to VX (including VX) in memory, starting at address I
+                        reg = (op & 0x0F00) >> 8;
+
+                        for (int i = 0; i <= reg; i++) {
+                            memory[(index + i) & 0xFFF] = v[i];
+                        }
+
+                        if (!(quirks & Chip8::QUIRK_LOAD_STORE))
+                            index = (uint16_t)(index + reg + 1);
+
+                        pc = (pc + 2) & 0xFFF;
+                        break;
+                    }
+
+                    case 0x65: {
+                        // FX65 - Fills from V0 to VX (including VX) with values from memory, starting at address I
+                        reg = (op & 0x0F00) >> 8;
+
+                        for (int i = 0; i <= reg; i++)
+                            v[i] = memory[(index + i) & 0xFFF];
+
+                        if (!(quirks & Chip8::QUIRK_LOAD_STORE))
+                            index = (uint16_t)(index + reg + 1);
+
+                        pc = (pc + 2) & 0xFFF;
+                        break;
+                    }
+                }
+
+                break;
+            }
+        }
+    }
+
+public:
+    void load_state(const Chip8State& state) {
+        memcpy(memory, state.memory, sizeof(memory));
+        for (int y = 0; y < 32; y++)
+            for (int x = 0; x < 64; x++)
+                display[y][x] = (state.display[y] >> (63 - x)) & 1;
+        draw_flag = true;
+
+        pc = state.pc;
+        index = state.index;
+        memcpy(stack, state.stack, sizeof(stack));
+        sp = state.sp;
+        memcpy(v, state.v, sizeof(v));
+
+        delay_timer = state.delay_timer;
+        sound_timer = state.sound_timer;
+
+        for (int i = 0; i < 16; i++)
+            keyboard[i] = (state.keys >> i) & 1;
+
+        rng_state = state.rng_state;
+    }
+
+    void save_state(Chip8State& state) const {
+        memcpy(state.memory, memory, sizeof(memory));
+        for (int y = 0; y < 32; y++) {
+            state.display[y] = 0;
+            for (int x = 0; x < 64; x++)
+                if (display[y][x])
+                    state.display[y] |= 1ull << (63 - x);
+        }
+
+        state.pc = pc;
+        state.index = index;
+        memcpy(state.stack, stack, sizeof(stack));
+        state.sp = sp;
+        memcpy(state.v, v, sizeof(v));
+
+        state.delay_timer = delay_timer;
+        state.sound_timer = sound_timer;
+
+        state.keys = 0;
+        for (int i = 0; i < 16; i++)
+            if (keyboard[i])
+                state.keys |= 1 << i;
+
+        state.rng_state = rng_state;
+    }
+
+    // setting like Chip8::set_quirks(), kept by load_state()
+    void set_quirks(uint8_t mask) {
+        quirks = mask;
+    }
+
+    void set_key(uint8_t key, bool pressed) {
+        keyboard[key & 0xF] = pressed;
+    }
+
+    void step(unsigned cycles) {
+        for (unsigned i = 0; i < cycles; i++)
+            single_cycle();
+    }
+
+    void tick_timers() {
+        if (delay_timer > 0) delay_timer--;
+        if (sound_timer > 0) sound_timer--;
+    }
+};
+
+#endif
@@ -0,0 +1,151 @@
+#include "vecenv.h"
+#include "render.h"
+#include "romlib.h"
+
+#include <algorithm>
+
+VecEnv::VecEnv(unsigned count, unsigned threads) : envs(count), episode_frames(count), episodes(count) {
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, std::max(1u, count));
+
+    // the caller runs slice 0, every worker one of the others
+    for (unsigned slice = 1; slice < threads; slice++)
+        workers.emplace_back(&VecEnv::worker, this, slice);
+}
+
+VecEnv::~VecEnv() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (std::thread& t : workers)
+        t.join();
+}
+
+bool VecEnv::load_rom(const uint8_t* data, size_t size) {
+    if (envs.empty() || !envs[0].load_rom(data, size))
+        return false;
+
+    // instructions per frame and quirks of known ROMs, copied along with the rest
+    RomSettings settings;
+    find_known_rom(RomHash::of(data, size), settings);
+    settings.apply(envs[0]);
+
+    // copies share the boot image and its memory pages
+    for (size_t i = 1; i < envs.size(); i++)
+        envs[i] = envs[0];
+    return true;
+}
+
+void VecEnv::seed(uint32_t value) {
+    base_seed = value;
+    std::fill(episodes.begin(), episodes.end(), 0);
+}
+
+void VecEnv::set_spec(const GameSpec& value) {
+    spec = value;
+    spec_values.assign((size_t)envs.size() * spec.values(), 0);
+}
+
+void VecEnv::start_episode(unsigned i) {
+    // seed from the environment and episode number, so runs repeat but episodes differ
+    uint64_t h = ((uint64_t)i << 32 | episodes[i]++) * 0x9E3779B97F4A7C15ull ^ base_seed;
+    h ^= h >> 29;
+
+    envs[i].reset_keep_rom();
+    envs[i].seed((uint32_t)(h ^ (h >> 32)));
+    episode_frames[i] = 0;
+
+    spec.sample(envs[i], spec_values.data() + (size_t)i * spec.values());
+}
+
+void VecEnv::reset(uint8_t* observations) {
+    job_actions = nullptr;
+    job_observations = observations;
+    job_rewards = nullptr;
+    job_dones = nullptr;
+    run();
+}
+
+void VecEnv::step(const uint16_t* actions, uint8_t* observations, float* rewards, uint8_t* dones) {
+    job_actions = actions;
+    job_observations = observations;
+    job_rewards = rewards;
+    job_dones = dones;
+    run();
+}
+
+void VecEnv::run_slice(unsigned slice) {
+    unsigned slices = (unsigned)workers.size() + 1;
+    unsigned begin = (unsigned)((uint64_t)envs.size() * slice / slices);
+    unsigned end = (unsigned)((uint64_t)envs.size() * (slice + 1) / slices);
+
+    for (unsigned i = begin; i < end; i++) {
+        Chip8& env = envs[i];
+
+        if (job_actions == nullptr) {
+            start_episode(i);
+        } else {
+            env.set_keys(job_actions[i]);
+
+            float reward = 0;
+            bool over = false;
+            if (spec.values() == 0) {
+                env.run_frames(frame_skip);
+                episode_frames[i] += frame_skip;
+            } else {
+                int32_t* values = spec_values.data() + (size_t)i * spec.values();
+                for (unsigned f = 0; f < frame_skip && !over; f++) {
+                    env.run_frame();
+                    episode_frames[i]++;
+                    over = spec.update(env, values, reward);
+                }
+            }
+
+            bool done = over || (max_episode_frames > 0 && episode_frames[i] >= max_episode_frames);
+            if (done)
+                start_episode(i);
+            job_rewards[i] = reward;
+            job_dones[i] = done;
+        }
+
+        expand_framebuffer_bytes(env.framebuffer(), job_observations + (size_t)i * OBSERVATION_SIZE);
+    }
+}
+
+void VecEnv::run() {
+    if (!workers.empty()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = (unsigned)workers.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    run_slice(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] { return running == 0; });
+}
+
+void VecEnv::worker(unsigned slice) {
+    uint64_t done_generation = 0;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != done_generation; });
+            if (stopping)
+                return;
+            done_generation = generation;
+        }
+
+        run_slice(slice);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--running == 0)
+            finished.notify_one();
+    }
+}
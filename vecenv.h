@@ -0,0 +1,74 @@
+#ifndef VECENV_H
+#define VECENV_H
+
+#include "chip8.h"
+#include "gamespec.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// N machines running the same ROM as reinforcement learning environments, stepped together
+// on a thread pool. An action is the mask of keys held during a step, bit per key 0-F.
+// Observations are written into a caller provided N x 32 x 64 uint8 tensor, 255 for a lit
+// pixel and 0 for a dark one, without allocating.
+class VecEnv {
+public:
+    static const unsigned OBSERVATION_SIZE = 32 * 64; // bytes of one observation
+
+    VecEnv(unsigned count, unsigned threads = 0); // 0 threads uses every hardware thread
+    ~VecEnv();
+
+    VecEnv(const VecEnv&) = delete;
+    VecEnv& operator=(const VecEnv&) = delete;
+
+    bool load_rom(const uint8_t* data, size_t size); // loads the ROM into every environment, with its settings when known
+
+    void seed(uint32_t value); // every episode of every environment gets its own seed derived from it
+    void set_frame_skip(unsigned frames) { frame_skip = frames > 0 ? frames : 1; } // frames per step, same action
+    void set_max_episode_frames(unsigned frames) { max_episode_frames = frames; } // 0 for no limit
+    void set_spec(const GameSpec& spec); // rewards and game over, evaluated after every frame
+
+    void reset(uint8_t* observations); // starts a new episode everywhere
+    // runs frame_skip frames with the given keys, or fewer when the game ends; rewards are summed
+    // over the frames, environments whose episode ended report done and are reset, their
+    // observation is the first one of the next episode
+    void step(const uint16_t* actions, uint8_t* observations, float* rewards, uint8_t* dones);
+
+    unsigned size() const { return (unsigned)envs.size(); }
+    const Chip8& env(unsigned i) const { return envs[i]; }
+
+private:
+    std::vector<Chip8> envs;
+    std::vector<unsigned> episode_frames; // frames run in the current episode
+    std::vector<uint32_t> episodes; // episodes started, for seeding
+
+    GameSpec spec;
+    std::vector<int32_t> spec_values; // last sampled values of the spec, spec.values() per environment
+
+    uint32_t base_seed = 1;
+    unsigned frame_skip = 4;
+    unsigned max_episode_frames = 60 * 60 * 5; // five minutes of play
+
+    // job shared with the workers, the caller runs the first slice itself
+    const uint16_t* job_actions = nullptr; // null for a reset
+    uint8_t* job_observations = nullptr;
+    float* job_rewards = nullptr;
+    uint8_t* job_dones = nullptr;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake; // a new job or stopping
+    std::condition_variable finished; // last worker is done
+    uint64_t generation = 0; // jobs handed out
+    unsigned running = 0; // workers still busy with the current job
+    bool stopping = false;
+
+    void worker(unsigned slice);
+    void run(); // runs the current job on every slice and waits for it
+    void run_slice(unsigned slice);
+    void start_episode(unsigned i);
+};
+
+#endif